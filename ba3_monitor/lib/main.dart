@@ -363,7 +363,7 @@ final String baseUrl ="http://192.168.1.1";
         body: jsonEncode({'deviceId': deviceId}),
         headers: {'Content-Type': 'application/json'},
       );
-      if (response.statusCode == 200) {
+      if (response.statusCode == 200 || response.statusCode == 202) {
         ScaffoldMessenger.of(context).showSnackBar(
           const SnackBar(content: Text('Device deleted from ESP32')),
         );
@@ -386,7 +386,7 @@ final String baseUrl ="http://192.168.1.1";
         body: jsonEncode(deviceMap),
         headers: {'Content-Type': 'application/json'},
       );
-      if (response.statusCode == 200) {
+      if (response.statusCode == 200 || response.statusCode == 202) {
         ScaffoldMessenger.of(context).showSnackBar(
           const SnackBar(content: Text('Data sent successfully')),
         );
@@ -413,7 +413,7 @@ Future<void> _setDefaultPercentage( int value) async {
 
      
 
-      if (response.statusCode == 200) {
+      if (response.statusCode == 200 || response.statusCode == 202) {
         // Parse response to ensure it's valid
         final responseData = jsonDecode(response.body);
         if (responseData['status'] == 'success') {
@@ -184,7 +184,7 @@ class _HomePageState extends State<HomePage> {
         body: jsonEncode(deviceMap),
         headers: {'Content-Type': 'application/json'},
       );
-      if (response.statusCode == 200) {
+      if (response.statusCode == 200 || response.statusCode == 202) {
         ScaffoldMessenger.of(context).showSnackBar(
           SnackBar(content: Text('Data sent successfully')),
         );
@@ -0,0 +1,62 @@
+#ifndef BOUNDED_STREAM_H
+#define BOUNDED_STREAM_H
+
+#include <Arduino.h>
+
+/**
+ * Read-only view of the next `limit` bytes of another stream, so a parser reading an HTTP body
+ * straight from the socket stops at `Content-Length` instead of running into the next response.
+ * Reads block up to the wrapped stream's timeout, like any `Stream`.
+ */
+class BoundedStream : public Stream {
+ public:
+  BoundedStream(Stream &source, size_t limit) : source(source), left(limit) {}
+
+  int available() override {
+    int n = source.available();
+    return (size_t)n > left ? (int)left : n;
+  }
+
+  int read() override {
+    if (left == 0) {
+      return -1;
+    }
+    int c = timedRead();
+    if (c >= 0) {
+      left--;
+    }
+    return c;
+  }
+
+  int peek() override {
+    return left == 0 ? -1 : source.peek();
+  }
+
+  size_t write(uint8_t) override {
+    return 0;
+  }
+
+  // Bytes of the body not consumed yet.
+  size_t remaining() const {
+    return left;
+  }
+
+ private:
+  // Waits for the next byte of `source` up to its timeout.
+  int timedRead() {
+    uint32_t start = millis();
+    do {
+      int c = source.read();
+      if (c >= 0) {
+        return c;
+      }
+      yield();
+    } while (millis() - start < source.getTimeout());
+    return -1;
+  }
+
+  Stream &source;
+  size_t left;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef FALLBACK_CACHE_H
+#define FALLBACK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FALLBACK_MAGIC 0x52454C31  // "REL1"
+#define AP_CACHE_MAGIC 0x41505031   // "APP1"
+#define DUTY_MAGIC 0x44555431       // "DUT1"
+
+#define RTC_CHANNELS 4  // Relay channels the records have room for
+
+// Last state heard from the monitor, kept in RTC memory so it survives a reset of the relay node.
+struct FallbackRecord {
+  uint32_t magic;
+  float percentage;
+  float trendPerMinute;  // Change of the percentage per minute, negative while discharging
+  float cutOff[RTC_CHANNELS];  // Per relay channel, in table order
+  uint32_t ageMs;        // Time since the reading when the record was written
+  uint32_t crc;          // CRC-32 of everything above
+};
+
+// Access point the node last joined, so a reconnect can skip the scan.
+struct ApRecord {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t crc;  // CRC-32 of everything above
+};
+
+/**
+ * Session kept across deep sleep in duty-cycled mode. Times are on the session clock, which keeps
+ * counting through sleep, unlike `millis()`.
+ */
+struct DutyRecord {
+  uint32_t magic;
+  uint32_t clockMs;       // Session clock at the next wake-up
+  uint32_t cycles;        // Wake-ups since the session began
+  uint32_t awakeMsTotal;
+  uint32_t sleepMsTotal;
+  // The last cycle, reported in the next poll
+  uint32_t lastAwakeMs;
+  uint32_t lastAverageUa;  // Estimated average current over the cycle
+  // Per relay channel, in table order
+  uint32_t lastSwitchMs[RTC_CHANNELS];  // When the relay last changed state
+  uint32_t switches[RTC_CHANNELS];
+  uint8_t loadOn[RTC_CHANNELS];
+  uint32_t crc;           // CRC-32 of everything above
+};
+
+// CRC-32 (IEEE) of `length` bytes.
+inline uint32_t rtcCrc(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+ * CRC-32 (IEEE) of a record, leaving out the `crc` field itself.
+ */
+inline uint32_t fallbackCrc(const FallbackRecord &record) {
+  return rtcCrc(&record, offsetof(FallbackRecord, crc));
+}
+
+inline bool fallbackValid(const FallbackRecord &record) {
+  return record.magic == FALLBACK_MAGIC && record.crc == fallbackCrc(record);
+}
+
+inline uint32_t apCrc(const ApRecord &record) {
+  return rtcCrc(&record, offsetof(ApRecord, crc));
+}
+
+inline bool apValid(const ApRecord &record) {
+  return record.magic == AP_CACHE_MAGIC && record.crc == apCrc(record);
+}
+
+inline uint32_t dutyCrc(const DutyRecord &record) {
+  return rtcCrc(&record, offsetof(DutyRecord, crc));
+}
+
+inline bool dutyValid(const DutyRecord &record) {
+  return record.magic == DUTY_MAGIC && record.crc == dutyCrc(record);
+}
+
+/**
+ * Smoothed rate of change of the battery percentage, from readings at irregular times.
+ */
+class ChargeTrend {
+ public:
+  ChargeTrend() : perMinute(0), lastPercent(0), lastMs(0), primed(false) {}
+
+  // Starts from a cached trend, e.g. after a reset.
+  void restore(float percent, float trendPerMinute, uint32_t nowMs) {
+    perMinute = trendPerMinute;
+    lastPercent = percent;
+    lastMs = nowMs;
+    primed = true;
+  }
+
+  void update(float percent, uint32_t nowMs) {
+    // Readings less than 10 s apart say more about noise than about the trend
+    if (primed && nowMs - lastMs < 10000) {
+      return;
+    }
+    if (primed) {
+      float instant = (percent - lastPercent) * 60000.0f / (nowMs - lastMs);
+      perMinute += (instant - perMinute) * 0.3f;
+    }
+    primed = true;
+    lastPercent = percent;
+    lastMs = nowMs;
+  }
+
+  float perMinuteRate() const {
+    return perMinute;
+  }
+
+  /**
+   * Extrapolates the percentage `elapsedMs` after `percent` was read. Only a falling trend is
+   * followed: guessing that the battery recovered could put loads back on that should stay off.
+   */
+  float predict(float percent, uint32_t elapsedMs) const {
+    float slope = perMinute < 0 ? perMinute : 0;
+    float predicted = percent + slope * elapsedMs / 60000.0f;
+    return predicted < 0 ? 0 : predicted;
+  }
+
+ private:
+  float perMinute;
+  float lastPercent;
+  uint32_t lastMs;
+  bool primed;
+};
+
+#endif
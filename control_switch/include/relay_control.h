@@ -0,0 +1,125 @@
+#ifndef RELAY_CONTROL_H
+#define RELAY_CONTROL_H
+
+#include <stdint.h>
+
+struct RelayControlConfig {
+  float hysteresisPercent;  // The load comes back once the charge is this far above the cut-off
+  uint32_t minOnMs;         // Shortest time the load stays on once switched on
+  uint32_t minOffMs;        // Shortest time it stays off, e.g. to protect a compressor
+};
+
+/**
+ * Decides whether the load should be powered from the battery percentage. The load is cut at or below
+ * the cut-off and restored at or above cut-off + hysteresis, and neither switch happens before the
+ * current state has lasted its minimum time. The first decision after boot is taken right away.
+ *
+ * Times are `millis()` values. Pure logic with no I/O, so it can be driven by a recorded or simulated
+ * charge trace.
+ */
+class RelayControl {
+ public:
+  RelayControl(RelayControlConfig config, float cutOffPercent)
+      : config(config), cutOff(cutOffPercent), on(true), decided(false), lastSwitchMs(0), switches(0), deferred(0) {}
+
+  void setCutOff(float percent) {
+    cutOff = percent;
+  }
+
+  float cutOffPercent() const {
+    return cutOff;
+  }
+
+  float restorePercent() const {
+    return cutOff + config.hysteresisPercent;
+  }
+
+  /**
+   * Feeds the latest percentage. Call it again now and then even without new readings, so a switch that
+   * was held back by the minimum times happens once they expire.
+   *
+   * @return true if the load changed state.
+   */
+  bool update(float percent, uint32_t nowMs) {
+    bool want = on;
+    if (on && percent <= cutOff) {
+      want = false;
+    } else if (!on && percent >= restorePercent()) {
+      want = true;
+    }
+    return request(want, nowMs);
+  }
+
+  /**
+   * Asks for the load to be on or off regardless of the charge, e.g. for a safe state, still subject
+   * to the minimum times.
+   *
+   * @return true if the load changed state.
+   */
+  bool request(bool want, uint32_t nowMs) {
+    if (!decided) {
+      decided = true;
+      lastSwitchMs = nowMs;
+      if (want != on) {
+        on = want;
+        switches++;
+        return true;
+      }
+      return false;
+    }
+    if (want == on) {
+      return false;
+    }
+
+    uint32_t dwellMs = on ? config.minOnMs : config.minOffMs;
+    if (nowMs - lastSwitchMs < dwellMs) {
+      deferred++;
+      return false;
+    }
+    on = want;
+    lastSwitchMs = nowMs;
+    switches++;
+    return true;
+  }
+
+  /**
+   * Picks up a decision taken before a reset, e.g. one kept through deep sleep, so the minimum times
+   * carry over. `lastSwitchMs` must be on the same clock as later updates.
+   */
+  void restore(bool loadOn, uint32_t lastSwitchMs, uint32_t switchCount) {
+    on = loadOn;
+    decided = true;
+    this->lastSwitchMs = lastSwitchMs;
+    switches = switchCount;
+  }
+
+  // When the load last changed state.
+  uint32_t lastSwitch() const {
+    return lastSwitchMs;
+  }
+
+  bool loadOn() const {
+    return on;
+  }
+
+  // Number of times the load changed state.
+  uint32_t switchCount() const {
+    return switches;
+  }
+
+  // Number of updates that wanted a switch the minimum times did not allow yet.
+  uint32_t deferredCount() const {
+    return deferred;
+  }
+
+ private:
+  RelayControlConfig config;
+  float cutOff;
+  bool on;
+  bool decided;
+  uint32_t lastSwitchMs;
+  uint32_t switches;
+  uint32_t deferred;
+};
+
+#endif
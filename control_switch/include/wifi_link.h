@@ -0,0 +1,169 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <stdint.h>
+
+enum WifiLinkAction {
+  LINK_NONE,
+  LINK_START,       // Begin a connection attempt with a full scan
+  LINK_START_FAST,  // Begin one on the cached BSSID and channel
+  LINK_ABORT,       // The attempt timed out; drop it
+  LINK_UP,          // Just connected
+  LINK_DOWN,        // Just lost the connection
+  LINK_RELEASE,     // The connection is no longer wanted; disconnect
+};
+
+struct WifiLinkConfig {
+  uint32_t attemptTimeoutMs;  // Longest a single attempt may take
+  uint32_t minBackoffMs;      // Wait after the first failure, and before reconnecting after a drop
+  uint32_t maxBackoffMs;      // Cap of the doubling wait
+};
+
+// Connection metrics, all times in milliseconds.
+struct WifiLinkStats {
+  uint32_t attempts;
+  uint32_t connects;
+  uint32_t disconnects;
+  uint32_t lastConnectMs;  // Duration of the attempt that succeeded last
+  uint32_t maxConnectMs;
+  uint32_t firstUpMs;      // `millis()` when the link first came up, 0 until then
+  uint32_t releases;       // Connections given up on purpose, not counted in `disconnects`
+};
+
+/**
+ * Connection state machine for the station interface, stepped from `loop()` so the relay keeps being
+ * controlled while the node is offline. Failed attempts are followed by a wait that doubles up to
+ * `maxBackoffMs`; the actual wait is random between half and all of it, so nodes that lost the
+ * monitor at the same moment do not come back at the same moment either. The first attempt after a
+ * drop or a reset uses the cached access point if there is one.
+ *
+ * A node that only associates for the length of a query clears `setWanted`; the link is then released
+ * and stays down without backoff until it is wanted again.
+ *
+ * Pure logic: the caller reports whether the station is connected and carries out the returned action.
+ */
+class WifiLink {
+ public:
+  explicit WifiLink(WifiLinkConfig config)
+      : config(config), state(IDLE), wanted(true), cached(false), failures(0), attemptStartMs(0), waitUntilMs(0), stats() {}
+
+  // Whether a cached BSSID and channel can be tried.
+  void setCached(bool available) {
+    cached = available;
+  }
+
+  // Whether the node wants to be connected at all. Set again, a released link starts right away.
+  void setWanted(bool want) {
+    wanted = want;
+  }
+
+  /**
+   * @param connected whether the station currently has a connection.
+   * @param random any random number, used for the jitter.
+   */
+  WifiLinkAction update(bool connected, uint32_t nowMs, uint32_t random) {
+    if (!wanted) {
+      if (state == IDLE) {
+        return LINK_NONE;
+      }
+      State previous = state;
+      state = IDLE;  // No backoff is left to wait out once the link is wanted again
+      if (previous == WAITING) {
+        return LINK_NONE;
+      }
+      if (previous == CONNECTING) {
+        failures++;  // So the next start scans instead of trying the cached access point again
+      }
+      stats.releases++;
+      return LINK_RELEASE;
+    }
+    switch (state) {
+      case IDLE:
+        return start(nowMs);
+
+      case CONNECTING:
+        if (connected) {
+          state = UP;
+          failures = 0;
+          stats.connects++;
+          stats.lastConnectMs = nowMs - attemptStartMs;
+          if (stats.lastConnectMs > stats.maxConnectMs) {
+            stats.maxConnectMs = stats.lastConnectMs;
+          }
+          if (stats.firstUpMs == 0) {
+            stats.firstUpMs = nowMs == 0 ? 1 : nowMs;
+          }
+          return LINK_UP;
+        }
+        if (nowMs - attemptStartMs >= config.attemptTimeoutMs) {
+          failures++;
+          wait(nowMs, random);
+          return LINK_ABORT;
+        }
+        return LINK_NONE;
+
+      case UP:
+        if (!connected) {
+          failures = 0;
+          stats.disconnects++;
+          wait(nowMs, random);
+          return LINK_DOWN;
+        }
+        return LINK_NONE;
+
+      case WAITING:
+        if ((int32_t)(nowMs - waitUntilMs) >= 0) {
+          return start(nowMs);
+        }
+        return LINK_NONE;
+    }
+    return LINK_NONE;
+  }
+
+  bool up() const {
+    return state == UP;
+  }
+
+  // Consecutive failed attempts.
+  uint32_t failureCount() const {
+    return failures;
+  }
+
+  const WifiLinkStats &metrics() const {
+    return stats;
+  }
+
+ private:
+  enum State { IDLE, CONNECTING, UP, WAITING };
+
+  WifiLinkAction start(uint32_t nowMs) {
+    state = CONNECTING;
+    attemptStartMs = nowMs;
+    stats.attempts++;
+    // A failed attempt on the cached access point may mean it moved channel, so retries scan.
+    return cached && failures == 0 ? LINK_START_FAST : LINK_START;
+  }
+
+  void wait(uint32_t nowMs, uint32_t random) {
+    uint32_t backoff = config.minBackoffMs;
+    for (uint32_t i = 1; i < failures && backoff < config.maxBackoffMs; i++) {
+      backoff *= 2;
+    }
+    if (backoff > config.maxBackoffMs) {
+      backoff = config.maxBackoffMs;
+    }
+    state = WAITING;
+    waitUntilMs = nowMs + backoff / 2 + random % (backoff / 2 + 1);
+  }
+
+  WifiLinkConfig config;
+  State state;
+  bool wanted;
+  bool cached;
+  uint32_t failures;
+  uint32_t attemptStartMs;
+  uint32_t waitUntilMs;
+  WifiLinkStats stats;
+};
+
+#endif
@@ -1,110 +1,1045 @@
 #include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
+#include <WiFiUdp.h>
 #include <ArduinoJson.h>
+#include <bounded_stream.h>
+#include <espnow_transport.h>
+#include <fallback_cache.h>
+#include <relay_control.h>
+#include <telemetry_wire.h>
+#include <wifi_link.h>
 
-#define RELAY_PIN 1  // GPIO1
+#define RELAY_PIN 1  // GPIO1, the only free pin on an ESP-01; boards with more GPIOs can add channels
 #define LED_PIN 0    // GPIO0
 
+// The monitor pushes a `telemetry` event on /events whenever the percentage moves, and at least every
+// 15 s. Polling is only a fallback.
+#define FALLBACK_POLL_MS 300000    // Heartbeat poll while subscribed
+#define UNSUBSCRIBED_POLL_MS 60000  // Poll rate while the event stream is down
+#define RECONNECT_MS 5000
+#define EVENT_TIMEOUT_MS 45000     // Three missed heartbeats: the stream is dead
+#define EVENT_LINE_SIZE 128
+#define POLL_TIMEOUT_MS 2000
+#define RELAY_HYSTERESIS_PERCENT 5  // Load comes back at threshold + 5 points
+#define RELAY_MIN_ON_MS 60000
+#define RELAY_MIN_OFF_MS 300000      // Gives a compressor time to equalize before restarting
+#define POLL_BODY_LIMIT 512        // Larger replies are refused unread; about 50 bytes plus 30 per channel
+
+// Without word from the monitor the relay keeps following the last reading, extrapolated along its
+// falling trend, for a while before it settles in the safe state.
+#define MONITOR_STALE_MS 60000      // No event or poll for this long: switch on the prediction
+#define FALLBACK_HOLD_MS 1800000    // How long a prediction is trusted
+#define RELAY_SAFE_LOAD_ON false    // Load state once the prediction has run out
+#define FALLBACK_RTC_OFFSET 0       // In 4-byte blocks of the RTC user memory
+#define FALLBACK_SAVE_MS 1000       // Age of the cache is saved at most this often while stale
+#define AP_RTC_OFFSET 12            // After the fallback record
+
+#define RADIO_INBOX_SIZE 4  // Power of two
+
+#define WIFI_ATTEMPT_TIMEOUT_MS 10000
+#define WIFI_MIN_BACKOFF_MS 2000
+#define WIFI_MAX_BACKOFF_MS 120000
+
+// Duty-cycled mode for battery-powered nodes (env:esp01_duty_cycle): the node wakes in the poll slot
+// the monitor assigned it, or every DUTY_SLEEP_MS until it has one, polls once and goes back to deep
+// sleep. The wake-up needs GPIO16 wired to RST, which
+// an ESP-01 does not break out, and the pins float during sleep, so each load is switched by a
+// dual-coil latching relay: set through the channel's pin, reset through its reset pin.
+//
+// Both coils are pulsed low, through drivers that stay off while their input is high, e.g. a P-channel
+// MOSFET with a 10k pull-up on its gate. GPIO2 must be high for the ESP8266 to boot at all, GPIO1 idles
+// high as the boot log's TX, and the pull-ups hold both drivers off while the pins float in deep sleep.
+// The boot log's low bits last microseconds, far too short to move a latch.
+#define DUTY_SLEEP_MS 600000
+#define DUTY_AWAKE_LIMIT_MS 15000  // Gives up on WiFi or the monitor after this long
+#define DUTY_MIN_SLEEP_MS 5000
+#define DUTY_RTC_OFFSET 16         // After the access point record
+#define RELAY_RESET_PIN 2          // GPIO2, a boot strap pin: idles high, see above
+#define RELAY_PULSE_MS 30
+#define DUTY_AWAKE_MA 70.0f        // Typical ESP8266 draw with the radio on
+#define DUTY_SLEEP_MA 0.02f        // Deep sleep, regulator quiescent current not included
+#define RELAY_PULSE_MA 150.0f      // Coil current of a 3 V latching relay
+
+// Session mode (env:esp01_sessions) for sites with more nodes than the monitor's softAP has slots: the
+// node only associates for the length of a poll, in its assigned slot, and is off the access point in
+// between. The relay keeps running on the last reading meanwhile, and ESP-NOW frames still arrive on
+// the channel of the last session.
+#define SESSION_LIMIT_MS 15000  // Gives up on WiFi or the monitor after this long
+#define SESSION_MIN_GAP_MS 5000
+
 const char* ssid = "ESP32_Battery_Monitor";
 const char* password = "";  // Set if the ESP32 has a password
 const char* serverIP = "192.168.1.1";  // IP address of the ESP32
-const char* deviceId = "myDeviceId";  // Device ID to query
 
-float setPercentage = 50;  // Set this to your threshold percentage
+// One switched circuit: the monitor device whose threshold it follows and the relay it drives. Each has
+// its own control state, so circuits with different thresholds switch independently.
+struct RelayChannel {
+  const char *deviceId;
+  uint8_t pin;
+  uint8_t resetPin;     // Reset coil of a latching relay, duty-cycled mode only
+  RelayControl control;  // Cut-off starts at 50% until the monitor sends this device's threshold
+  bool written;          // The pin has been set from `control` at least once
+};
+
+const RelayControlConfig relayConfig = {RELAY_HYSTERESIS_PERCENT, RELAY_MIN_ON_MS, RELAY_MIN_OFF_MS};
+
+// All of them are fetched with a single /getVoltageByIds request.
+RelayChannel channels[] = {
+  {"myDeviceId", RELAY_PIN, RELAY_RESET_PIN, RelayControl(relayConfig, 50), false},
+};
+
+#define CHANNEL_COUNT (sizeof(channels) / sizeof(channels[0]))
+static_assert(CHANNEL_COUNT <= RTC_CHANNELS, "RTC records have room for RTC_CHANNELS channels");
+
+WiFiClient client;       // Polls /getVoltageByIds, kept open between polls when the server allows it
+WiFiClient eventClient;  // Stays subscribed to /events
+
+float percentage = -1;     // Last known battery percentage, -1 until the first reading
+uint32_t lastReadingMs = 0;  // When `percentage` was heard from the monitor
+uint32_t lastFallbackSaveMs = 0;
+bool fallbackLogged = false;
+ChargeTrend chargeTrend;
+
+WifiLink wifiLink(WifiLinkConfig{WIFI_ATTEMPT_TIMEOUT_MS, WIFI_MIN_BACKOFF_MS, WIFI_MAX_BACKOFF_MS});
+ApRecord apCache;
+
+// Clock for relay and fallback timing. In duty-cycled mode it keeps counting across deep sleep.
+uint32_t clockBaseMs = 0;
+#ifdef RELAY_DUTY_CYCLE
+DutyRecord duty;
+uint32_t relayPulses = 0;  // Coil pulses this wake-up
+bool dutyAnswered = false;  // The monitor answered this wake-up's poll
+#endif
+#ifdef RELAY_SESSIONS
+bool sessionOpen = false;
+uint32_t sessionStartMs = 0;
+uint32_t nextSessionMs = 0;  // Due right after boot
+uint32_t sessions = 0;
+uint32_t sessionsAnswered = 0;
+uint32_t sessionMsTotal = 0;
+#endif
+
+// Server-sent event parser state
+char eventLine[EVENT_LINE_SIZE];
+size_t eventLineLength = 0;
+char eventName[16];
+char eventData[EVENT_LINE_SIZE];
+bool eventHeadersDone = false;
+uint32_t lastEventMs = 0;
+uint32_t lastConnectMs = 0;
+uint32_t lastPollMs = 0;
+// Poll schedule assigned by the monitor with each reply, used while no push channel is fresh
+bool haveSchedule = false;
+uint32_t scheduleIntervalMs = 0;
+uint32_t nextPollAtMs = 0;
+bool polledOnce = false;
+uint32_t thresholdGeneration = 0;
+bool haveGeneration = false;
+
+// ESP-NOW: the monitor broadcasts signed telemetry and threshold frames, which reach the relays within a
+// few milliseconds, and each one acted on is acknowledged with the relay states. The driver's callback
+// only copies frames into `radioInbox`; loop() handles them. /events and polling stay as the fallback.
+struct RadioInbound {
+  uint8_t from[TRANSPORT_ADDRESS_SIZE];
+  uint8_t length;
+  uint8_t data[sizeof(WireRadioThresholdsFrame)];  // The largest radio frame
+};
+
+EspNowTransport radio;
+const uint8_t radioKey[SIPHASH_KEY_SIZE] = WIRE_RADIO_KEY;
+RadioInbound radioInbox[RADIO_INBOX_SIZE];
+volatile uint8_t radioInboxHead = 0;  // Written by the callback only
+volatile uint8_t radioInboxTail = 0;  // Written by loop() only
+WireReplayWindow radioReplay = {};  // ESP-NOW frames; beacons have their own sequence, see `beaconReplay`
+uint32_t monitorEpoch = 0;              // Latest monitor boot seen on either transport
+uint32_t radioThresholdEpoch = 0;       // Boot and generation the pages below belong to
+uint32_t radioThresholdGeneration = 0;
+uint8_t radioPagesSeen = 0;             // Bit n: page n of that generation arrived
+uint8_t radioChannelsListed = 0;        // Bit n: channel n had an entry in one of them
+bool radioThresholdsComplete = false;
+uint32_t radioFrames = 0;
+uint32_t radioRejected = 0;
+
+// The monitor's UDP multicast beacon. While beacons arrive the event stream is closed, so the monitor's
+// load does not grow with the number of nodes; thresholds are only polled when the table hash changes.
+WiFiUDP beaconUdp;
+WireReplayWindow beaconReplay = {};
+uint32_t tableHash = 0;
+bool haveTableHash = false;
+uint32_t lastBeaconMs = 0;
+bool beaconSeen = false;
+uint32_t beacons = 0;
+
+// Poll client buffers, allocated once. The node's counters go along in the query of each poll, for the
+// monitor's /nodes: on an ESP-01 nothing printed to Serial is ever read, as TX drives the relay.
+char pollPath[160];  // The part of the request line that never changes
+char pollRequest[400];  // Room for the longest path with every counter at its largest
+char pollLine[EVENT_LINE_SIZE];
+uint32_t pollConnects = 0;
+uint32_t pollReuses = 0;
+uint32_t pollParseHeap = 0;  // What parsing the last reply took from the heap
+JsonDocument pollFilter;  // Only the fields pollDevice() uses are kept when parsing
+
+void subscribe();
+void readEvents();
+void handleEventLine();
+void dispatchEvent();
+bool pollDevice();
+size_t buildPollRequest();
+bool readPollLine(uint32_t deadlineMs);
+void applyRelay();
+void noteReading();
+void restoreFallback();
+void saveFallback(uint32_t now);
+bool serviceWiFi();
+void writeRelay(const RelayChannel &channel, bool loadOn);
+void onRadioFrame(void *context, const uint8_t *from, const uint8_t *data, size_t len);
+void processRadio();
+bool acceptRadioFrame(WireReplayWindow &window, uint32_t epoch, uint32_t seq);
+void handleRadioThresholds(const WireRadioThresholdsFrame &frame);
+void handleRadioTelemetry(const uint8_t *from, const WireRadioTelemetryFrame &frame);
+void waitForRadio(uint32_t ms);
+void readBeacons();
+uint32_t clockMs();
+#ifdef RELAY_DUTY_CYCLE
+void restoreDuty();
+void dutyCycle();
+#endif
+#ifdef RELAY_SESSIONS
+void sessionCycle();
+void closeSession(bool answered);
+#endif
+#ifdef WIRE_BENCHMARK
+void runWireBenchmark();
+#endif
 
 void setup() {
   Serial.begin(115200);
-  pinMode(RELAY_PIN, OUTPUT);
+#ifdef WIRE_BENCHMARK
+  runWireBenchmark();  // While GPIO1 is still the UART's TX, before it becomes the relay pin
+#endif
   pinMode(LED_PIN, OUTPUT);
+  digitalWrite(LED_PIN, HIGH);     // Offline
+  for (RelayChannel &channel : channels) {
+#ifdef RELAY_DUTY_CYCLE
+    // Idle level first, so the coil drivers never see the pins go low when they become outputs
+    digitalWrite(channel.pin, HIGH);
+    digitalWrite(channel.resetPin, HIGH);
+    pinMode(channel.pin, OUTPUT);
+    pinMode(channel.resetPin, OUTPUT);
+#else
+    pinMode(channel.pin, OUTPUT);
+    writeRelay(channel, RELAY_SAFE_LOAD_ON);  // Until its control decides
+#endif
+  }
+#ifdef RELAY_DUTY_CYCLE
+  restoreDuty();  // The latched relays keep their state through sleep; only a cold boot sets them
+#endif
+
+  restoreFallback();
+  applyRelay();
+
+  // wifiLink decides when to connect; the SDK's own reconnects would retry in lockstep with every other
+  // node and bypass the backoff.
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  WiFi.mode(WIFI_STA);
+  ESP.rtcUserMemoryRead(AP_RTC_OFFSET, (uint32_t *)&apCache, sizeof(apCache));
+  wifiLink.setCached(apValid(apCache));
+#ifdef RELAY_SESSIONS
+  wifiLink.setWanted(false);  // Until the first session opens
+#endif
+#ifndef RELAY_DUTY_CYCLE
+  radio.onReceive(onRadioFrame, NULL);
+  if (!radio.begin()) {
+    Serial.println("ESP-NOW unavailable");
+  }
+#endif
 
-  // Initialize WiFi
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  // The devices never change, and neither does the duty cycle being reported: a duty-cycled node wakes
+  // with a fresh boot each cycle and reports the previous one.
+  char ids[128];
+  size_t idsLength = 0;
+  for (const RelayChannel &channel : channels) {
+    idsLength += snprintf(ids + idsLength, sizeof(ids) - idsLength, "%s%s", idsLength ? "," : "", channel.deviceId);
   }
-  Serial.println("Connected to WiFi");
+  char status[48] = "";
+#ifdef RELAY_DUTY_CYCLE
+  if (duty.cycles > 0) {
+    snprintf(status, sizeof(status), "&awakeMs=%u&uA=%u", (unsigned)duty.lastAwakeMs, (unsigned)duty.lastAverageUa);
+  }
+#endif
+  snprintf(pollPath, sizeof(pollPath), "/getVoltageByIds?deviceIds=%s%s", ids, status);
+
+  pollFilter["percentage"] = true;
+  pollFilter["devices"][0]["deviceId"] = true;  // The first element's filter applies to all of them
+  pollFilter["devices"][0]["voltage"] = true;
+  pollFilter["pollIntervalMs"] = true;
+  pollFilter["nextPollMs"] = true;
+  client.setTimeout(POLL_TIMEOUT_MS);
 }
 
 void loop() {
-  if (WiFi.status() == WL_CONNECTED) {
-    HTTPClient http;
-       String url = String("http://") + serverIP + "/getVoltageById?deviceId=" + deviceId;
-  
-    http.begin(url);
-
-    int httpCode = http.GET();
-    if (httpCode > 0) {
-           digitalWrite(LED_PIN, LOW); // Turn on LED
-      String payload = http.getString();
-      Serial.println(payload);
-
-      // Parse JSON response
-      StaticJsonDocument<200> jsonDoc;
-      DeserializationError error = deserializeJson(jsonDoc, payload);
-      if (!error) {
-        float voltage = jsonDoc["voltage"];
-     char* device = jsonDoc["deviceId"];
-     if(deviceId != device){
-        Serial.println("Device ID does not match");
-        return;
-      }
+#ifdef RELAY_DUTY_CYCLE
+  dutyCycle();
+  return;
+#endif
+#ifdef RELAY_SESSIONS
+  sessionCycle();
+  return;
+#endif
+  processRadio();
+  if (!serviceWiFi()) {
+    applyRelay();  // Runs on the cached reading
+    waitForRadio(10);
+    return;
+  }
+
+  readBeacons();
+  uint32_t now = millis();
+  bool beaconsFresh = beaconSeen && now - lastBeaconMs < EVENT_TIMEOUT_MS;
+  if (beaconsFresh) {
+    if (eventClient.connected()) {
+      Serial.println("Following beacons, event stream closed");
+      eventClient.stop();
+    }
+  } else if (!eventClient.connected()) {
+    if (now - lastConnectMs >= RECONNECT_MS) {
+      subscribe();
+    }
+  } else {
+    readEvents();
+    if (millis() - lastEventMs > EVENT_TIMEOUT_MS) {
+      Serial.println("Event stream timed out");
+      eventClient.stop();
+    }
+  }
+
+  // Pushed updates leave polling as a slow heartbeat. Without them the node polls in its assigned slot.
+  bool pollDue;
+  if (!polledOnce) {
+    pollDue = true;
+  } else if (eventClient.connected() || beaconsFresh) {
+    pollDue = millis() - lastPollMs >= FALLBACK_POLL_MS;
+  } else if (haveSchedule) {
+    pollDue = (int32_t)(millis() - nextPollAtMs) >= 0;
+  } else {
+    pollDue = millis() - lastPollMs >= UNSUBSCRIBED_POLL_MS;
+  }
+  if (pollDue) {
+    pollDevice();
+  }
+
+  applyRelay();  // Carries out switches held back by the minimum on/off times
+  waitForRadio(10);  // Lets the WiFi stack run, but radio frames are handled as soon as they arrive
+}
+
+/**
+ * The function `serviceWiFi` steps `wifiLink` and carries out what it asks for. Never blocks.
+ *
+ * @return true if the station is connected.
+ */
+bool serviceWiFi() {
+  switch (wifiLink.update(WiFi.status() == WL_CONNECTED, millis(), ESP.random())) {
+    case LINK_START_FAST:
+      WiFi.begin(ssid, password, apCache.channel, apCache.bssid);
+      break;
+    case LINK_START:
+      WiFi.begin(ssid, password);
+      break;
+    case LINK_ABORT:
+      WiFi.disconnect();
+      Serial.print("WiFi attempt failed, failures: ");
+      Serial.println(wifiLink.failureCount());
+      break;
+    case LINK_UP: {
+      const WifiLinkStats &stats = wifiLink.metrics();
+      Serial.print("Connected to WiFi in ");
+      Serial.print(stats.lastConnectMs);
+      Serial.print(" ms, attempts: ");
+      Serial.print(stats.attempts);
+      Serial.print(", drops: ");
+      Serial.print(stats.disconnects);
+      Serial.print(", boot to online: ");
+      Serial.print(stats.firstUpMs);
+      Serial.println(" ms");
+
+      apCache.magic = AP_CACHE_MAGIC;
+      memcpy(apCache.bssid, WiFi.BSSID(), sizeof(apCache.bssid));
+      apCache.channel = WiFi.channel();
+      apCache.reserved = 0;
+      apCache.crc = apCrc(apCache);
+      ESP.rtcUserMemoryWrite(AP_RTC_OFFSET, (uint32_t *)&apCache, sizeof(apCache));
+      wifiLink.setCached(true);
+      polledOnce = false;  // Catch up right away
+      beaconUdp.beginMulticast(WiFi.localIP(), IPAddress(WIRE_BEACON_GROUP), WIRE_BEACON_PORT);
+      break;
+    }
+    case LINK_DOWN:
+      digitalWrite(LED_PIN, HIGH); // Turn on LED
+      Serial.println("Disconnected from WiFi");
+      eventClient.stop();
+      client.stop();
+      beaconUdp.stop();
+      break;
+    case LINK_RELEASE:
+      digitalWrite(LED_PIN, HIGH);
+      eventClient.stop();
+      client.stop();
+      beaconUdp.stop();
+      WiFi.disconnect();
+      break;
+    case LINK_NONE:
+      break;
+  }
+  return wifiLink.up();
+}
+
+// Runs in the ESP-NOW driver's context: just copies the frame for processRadio().
+void onRadioFrame(void *context, const uint8_t *from, const uint8_t *data, size_t len) {
+  uint8_t head = radioInboxHead;
+  if ((uint8_t)(head - radioInboxTail) >= RADIO_INBOX_SIZE || len > sizeof(radioInbox[0].data)) {
+    return;  // Full or not one of ours; a lost frame is covered by the next one or by /events
+  }
+  RadioInbound &slot = radioInbox[head % RADIO_INBOX_SIZE];
+  memcpy(slot.from, from, TRANSPORT_ADDRESS_SIZE);
+  memcpy(slot.data, data, len);
+  slot.length = len;
+  radioInboxHead = head + 1;
+}
+
+// Sleeps up to `ms`, returning early once a radio frame is waiting.
+void waitForRadio(uint32_t ms) {
+  for (uint32_t i = 0; i < ms && radioInboxHead == radioInboxTail; i++) {
+    delay(1);
+  }
+}
+
+/**
+ * The function `processRadio` handles the frames queued by `onRadioFrame`. Frames that do not decode,
+ * fail the tag or are not newer than the last one accepted are dropped.
+ */
+void processRadio() {
+  while (radioInboxTail != radioInboxHead) {
+    RadioInbound &slot = radioInbox[radioInboxTail % RADIO_INBOX_SIZE];
+    WireHeader header;
+    memcpy(&header, slot.data, sizeof(header));
 
-        if(voltage){
-          setPercentage = voltage;
-        }
-        float percentage = jsonDoc["percentage"];
-
-        // Print values for debugging
-        Serial.print("Voltage: ");
-        Serial.println(voltage);
-        Serial.print("Percentage: ");
-        Serial.println(percentage);
-
-        // Control relay and LED based on percentage
-        if (percentage <= setPercentage) {
-          digitalWrite(RELAY_PIN, HIGH); // Turn off relay
-        // Turn on LED
-        } else {
-          digitalWrite(RELAY_PIN, LOW);  // Turn on relay
-          // Turn off LED
-        }
+    if (header.type == WIRE_FRAME_RADIO_TELEMETRY) {
+      WireRadioTelemetryFrame frame;
+      if (wireDecode(slot.data, slot.length, header.type, &frame, sizeof(frame)) &&
+          wireVerify(&frame, sizeof(frame), radioKey) && acceptRadioFrame(radioReplay, frame.epoch, frame.seq)) {
+        handleRadioTelemetry(slot.from, frame);
       } else {
-        Serial.println("Failed to parse JSON");
+        radioRejected++;
+      }
+    } else if (header.type == WIRE_FRAME_RADIO_THRESHOLDS) {
+      WireRadioThresholdsFrame frame;
+      if (wireDecode(slot.data, slot.length, header.type, &frame, sizeof(frame)) &&
+          wireVerify(&frame, sizeof(frame), radioKey) && acceptRadioFrame(radioReplay, frame.epoch, frame.seq)) {
+        handleRadioThresholds(frame);
+      } else {
+        radioRejected++;
       }
     } else {
+      radioRejected++;
+    }
+    radioInboxTail = radioInboxTail + 1;
+  }
+}
+
+/**
+ * The function `acceptRadioFrame` drops replays through the replay window of the transport the frame
+ * came in on, and counts the frames taken. Both transports carry the same monitor boot counter, so a
+ * boot seen on one also rules out frames of earlier boots on the other.
+ */
+bool acceptRadioFrame(WireReplayWindow &window, uint32_t epoch, uint32_t seq) {
+  if (epoch < monitorEpoch || !window.accept(epoch, seq)) {
+    return false;
+  }
+  monitorEpoch = epoch;
+  radioFrames++;
+  return true;
+}
+
+/**
+ * The function `handleRadioThresholds` applies one page of thresholds. Once every page of a
+ * generation has arrived, channels none of them listed get the monitor's default, as a poll would.
+ */
+void handleRadioThresholds(const WireRadioThresholdsFrame &frame) {
+  if (frame.epoch == radioThresholdEpoch && (int32_t)(frame.generation - radioThresholdGeneration) < 0) {
+    return;  // A page of thresholds that have changed since
+  }
+  if (frame.epoch != radioThresholdEpoch || frame.generation != radioThresholdGeneration) {
+    radioThresholdEpoch = frame.epoch;
+    radioThresholdGeneration = frame.generation;
+    radioPagesSeen = 0;
+    radioChannelsListed = 0;
+    radioThresholdsComplete = false;
+  }
+
+  for (uint8_t i = 0; i < frame.count && i < WIRE_RADIO_THRESHOLDS_MAX; i++) {
+    const WireRadioThreshold &entry = frame.entries[i];
+    for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+      if (strncmp(channels[c].deviceId, entry.deviceId, WIRE_DEVICE_ID_SIZE) == 0) {
+        channels[c].control.setCutOff(entry.threshold);
+        radioChannelsListed |= 1 << c;
+      }
+    }
+  }
+
+  uint8_t pages = frame.total == 0 ? 1 : (frame.total + WIRE_RADIO_THRESHOLDS_MAX - 1) / WIRE_RADIO_THRESHOLDS_MAX;
+  radioPagesSeen |= 1 << (frame.first / WIRE_RADIO_THRESHOLDS_MAX);
+  if (!radioThresholdsComplete && radioPagesSeen == (uint8_t)((1 << pages) - 1)) {
+    radioThresholdsComplete = true;
+    for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+      if (!(radioChannelsListed & (1 << c))) {
+        channels[c].control.setCutOff(frame.defaultThreshold);
+      }
+    }
+  }
+}
+
+/**
+ * The function `handleRadioTelemetry` takes in the broadcast percentage, switches the relays and
+ * acknowledges with their states. If the thresholds moved on and not all of their pages arrived, they
+ * are fetched over HTTP instead.
+ */
+void handleRadioTelemetry(const uint8_t *from, const WireRadioTelemetryFrame &frame) {
+  percentage = frame.percentageCenti / 100.0f;
+  noteReading();
+
+  if (!haveGeneration || frame.generation != thresholdGeneration) {
+    if ((radioThresholdsComplete && radioThresholdEpoch == frame.epoch && radioThresholdGeneration == frame.generation) ||
+        (WiFi.status() == WL_CONNECTED && pollDevice())) {
+      thresholdGeneration = frame.generation;
+      haveGeneration = true;
+    }
+  }
+  applyRelay();
+
+  WireRadioRelayStateFrame ack;
+  wireInitHeader(ack.header, WIRE_FRAME_RADIO_RELAY_STATE, sizeof(ack));
+  ack.epoch = frame.epoch;
+  ack.seq = frame.seq;
+  ack.channels = CHANNEL_COUNT;
+  ack.loadOnMask = 0;
+  uint32_t switches = 0;
+  for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+    ack.loadOnMask |= (channels[c].control.loadOn() ? 1 : 0) << c;
+    switches += channels[c].control.switchCount();
+  }
+  ack.switches = switches;
+  wireSign(&ack, sizeof(ack), radioKey);
+  radio.send(from, (const uint8_t *)&ack, sizeof(ack));
+}
+
+/**
+ * The function `readBeacons` handles the monitor's multicast beacons that arrived since the last call.
+ * They pass the same tag check as radio frames, and a replay check on the beacons' own sequence.
+ */
+void readBeacons() {
+  while (beaconUdp.parsePacket() > 0) {
+    uint8_t data[sizeof(WireBeaconFrame)];
+    int length = beaconUdp.read(data, sizeof(data));
+    WireBeaconFrame frame;
+    if (length < 0 || !wireDecode(data, length, WIRE_FRAME_BEACON, &frame, sizeof(frame)) ||
+        !wireVerify(&frame, sizeof(frame), radioKey) || !acceptRadioFrame(beaconReplay, frame.epoch, frame.seq)) {
+      radioRejected++;
+      continue;
+    }
+    beacons++;
+    beaconSeen = true;
+    lastBeaconMs = millis();
+    percentage = frame.percentageCenti / 100.0f;
+    noteReading();
+
+    if ((!haveTableHash || frame.tableHash != tableHash) && pollDevice()) {
+      tableHash = frame.tableHash;
+      haveTableHash = true;
+    }
+    applyRelay();
+  }
+}
+
+/**
+ * The function `subscribe` opens the long-lived `/events` request. The response is read
+ * incrementally by `readEvents`.
+ */
+void subscribe() {
+  lastConnectMs = millis();
+  if (!eventClient.connect(serverIP, 80)) {
+    Serial.println("Event stream connect failed");
+    return;
+  }
+  eventClient.setNoDelay(true);
+  eventClient.print(String("GET /events HTTP/1.1\r\nHost: ") + serverIP + "\r\nAccept: text/event-stream\r\n\r\n");
+
+  eventHeadersDone = false;
+  eventLineLength = 0;
+  eventName[0] = 0;
+  eventData[0] = 0;
+  lastEventMs = millis();
+}
+
+// Splits whatever arrived on the event stream into lines.
+void readEvents() {
+  while (eventClient.available() > 0) {
+    char c = eventClient.read();
+    if (c == '\r') {
+      continue;
+    }
+    if (c == '\n') {
+      eventLine[eventLineLength] = 0;
+      handleEventLine();
+      eventLineLength = 0;
+    } else if (eventLineLength < EVENT_LINE_SIZE - 1) {
+      eventLine[eventLineLength++] = c;  // Longer lines are truncated, and then fail to parse
+    }
+  }
+}
+
+/**
+ * The function `handleEventLine` handles one line of the stream: the HTTP headers first, then
+ * `event:` and `data:` fields, with an empty line ending each event.
+ */
+void handleEventLine() {
+  if (!eventHeadersDone) {
+    if (strncmp(eventLine, "HTTP/1.1 ", 9) == 0 && strncmp(eventLine + 9, "200", 3) != 0) {
+      Serial.println("Event stream refused");
+      eventClient.stop();
+    }
+    eventHeadersDone = eventLineLength == 0;
+    return;
+  }
+
+  if (eventLineLength == 0) {
+    dispatchEvent();
+    eventName[0] = 0;
+    eventData[0] = 0;
+  } else if (strncmp(eventLine, "event:", 6) == 0) {
+    strncpy(eventName, eventLine + 6 + (eventLine[6] == ' '), sizeof(eventName) - 1);
+    eventName[sizeof(eventName) - 1] = 0;
+  } else if (strncmp(eventLine, "data:", 5) == 0) {
+    strncpy(eventData, eventLine + 5 + (eventLine[5] == ' '), sizeof(eventData) - 1);
+    eventData[sizeof(eventData) - 1] = 0;
+  }
+  // Anything else, like `id:` or `:` comments, is ignored
+}
+
+void dispatchEvent() {
+  if (strcmp(eventName, "telemetry") != 0) {
+    return;
+  }
+  lastEventMs = millis();
+
+  JsonDocument jsonDoc;
+  if (deserializeJson(jsonDoc, eventData)) {
+    Serial.println("Failed to parse event");
+    return;
+  }
+  percentage = jsonDoc["percentage"];
+  noteReading();
+  uint32_t generation = jsonDoc["gen"];
+
+  // A threshold may have changed on the monitor; ours are only available from /getVoltageByIds.
+  if (!haveGeneration || generation != thresholdGeneration) {
+    if (pollDevice()) {
+      thresholdGeneration = generation;
+      haveGeneration = true;
+    }
+  }
+  applyRelay();
+}
+
+/**
+ * The function `pollDevice` fetches the threshold of every channel and the battery percentage with one
+ * `/getVoltageByIds` request and applies them. The request is rebuilt with the current counters and
+ * sent on `client`; the headers are read into a fixed buffer and the body is parsed straight from the
+ * socket, keeping only the fields in `pollFilter`. The connection is reused unless the server closed
+ * it or answered with `Connection: close`.
+ *
+ * @return true if the monitor answered with data for at least one channel.
+ */
+bool pollDevice() {
+  lastPollMs = millis();
+  polledOnce = true;
+  nextPollAtMs = lastPollMs + (haveSchedule ? scheduleIntervalMs : UNSUBSCRIBED_POLL_MS);  // Unless the reply moves it
+
+  bool reused = client.connected();
+  if (reused) {
+    pollReuses++;
+  } else {
+    client.stop();
+    if (!client.connect(serverIP, 80)) {
       Serial.println("HTTP GET request failed");
+      return false;
+    }
+    client.setNoDelay(true);
+    pollConnects++;
+  }
+  client.write((const uint8_t *)pollRequest, buildPollRequest());
+
+  uint32_t deadlineMs = millis() + POLL_TIMEOUT_MS;
+  if (!readPollLine(deadlineMs) || strncmp(pollLine, "HTTP/1.", 7) != 0) {
+    client.stop();
+    if (reused) {
+      return pollDevice();  // The server dropped the idle connection; retry once on a fresh one
+    }
+    Serial.println("HTTP GET request failed");
+    return false;
+  }
+  int httpCode = atoi(pollLine + 9);
+       digitalWrite(LED_PIN, LOW); // Turn on LED
+
+  long contentLength = -1;
+  bool closeAfter = false;
+  for (;;) {
+    if (!readPollLine(deadlineMs)) {
+      client.stop();
+      return false;
+    }
+    if (pollLine[0] == 0) {
+      break;  // End of headers
+    }
+    if (strncasecmp(pollLine, "Content-Length:", 15) == 0) {
+      contentLength = atol(pollLine + 15);
+    } else if (strncasecmp(pollLine, "Connection:", 11) == 0 && strstr(pollLine, "close") != NULL) {
+      closeAfter = true;
+    }
+  }
+
+  // Without a usable length the body cannot be skipped, so the connection is dropped instead.
+  if (httpCode != 200 || contentLength < 0 || contentLength > POLL_BODY_LIMIT) {
+    Serial.println("Unexpected response");
+    client.stop();
+    return false;
+  }
+
+  // Parse the MessagePack response as it arrives. The heap drop across the parse, with the document
+  // still alive, is what a poll costs at its peak.
+  uint32_t heapBefore = ESP.getFreeHeap();
+  BoundedStream body(client, contentLength);
+  JsonDocument jsonDoc;
+  DeserializationError error = deserializeMsgPack(jsonDoc, body, DeserializationOption::Filter(pollFilter));
+  pollParseHeap = heapBefore - ESP.getFreeHeap();
+  if (closeAfter || error || body.remaining() > 0) {
+    client.stop();  // Also when the body was not fully read, so the next reply starts clean
+  }
+  if (error) {
+    Serial.println("Failed to parse response");
+    return false;
+  }
+
+  if (jsonDoc["pollIntervalMs"].is<uint32_t>()) {
+    haveSchedule = true;
+    scheduleIntervalMs = jsonDoc["pollIntervalMs"];
+    nextPollAtMs = millis() + jsonDoc["nextPollMs"].as<uint32_t>();
+  }
+
+  size_t matched = 0;
+  for (JsonObject entry : jsonDoc["devices"].as<JsonArray>()) {
+    const char* device = entry["deviceId"];
+    float voltage = entry["voltage"];
+    for (RelayChannel &channel : channels) {
+      if (device == NULL || strcmp(channel.deviceId, device) != 0) {
+        continue;
+      }
+      matched++;
+      if(voltage){
+        channel.control.setCutOff(voltage);
+      }
+    }
+  }
+  if (matched == 0) {
+    Serial.println("Device ID does not match");
+    return false;
+  }
+  percentage = jsonDoc["percentage"];
+  noteReading();
+
+  applyRelay();
+  return true;
+}
+
+/**
+ * The function `buildPollRequest` puts the next poll request together in `pollRequest`: `pollPath`
+ * from setup() and the node's counters so far.
+ *
+ * @return Its length.
+ */
+size_t buildPollRequest() {
+  return snprintf(pollRequest, sizeof(pollRequest),
+                  "GET %s&connects=%u&reuses=%u&parseHeap=%u&beacons=%u&radioFrames=%u&radioRejected=%u HTTP/1.1\r\n"
+                  "Host: %s\r\nAccept: %s\r\nConnection: keep-alive\r\n\r\n",
+                  pollPath, (unsigned)pollConnects, (unsigned)pollReuses, (unsigned)pollParseHeap, (unsigned)beacons,
+                  (unsigned)radioFrames, (unsigned)radioRejected, serverIP, WIRE_MIME_MSGPACK);
+}
+
+/**
+ * The function `readPollLine` reads one CRLF-terminated line of the poll response into `pollLine`,
+ * without the line ending. Longer lines are truncated.
+ *
+ * @return false if the line did not arrive before `deadlineMs`.
+ */
+bool readPollLine(uint32_t deadlineMs) {
+  size_t length = 0;
+  while ((int32_t)(millis() - deadlineMs) < 0) {
+    int c = client.read();
+    if (c < 0) {
+      if (!client.connected()) {
+        return false;
+      }
+      delay(1);
+      continue;
+    }
+    if (c == '\n') {
+      pollLine[length] = 0;
+      return true;
+    }
+    if (c != '\r' && length < EVENT_LINE_SIZE - 1) {
+      pollLine[length++] = c;
     }
-    http.end();
+  }
+  return false;
+}
+
+/**
+ * The function `applyRelay` controls each channel's relay through the hysteresis and minimum on/off
+ * times of its `control`. Fresh readings are used as they are. Once the monitor has been silent for
+ * `MONITOR_STALE_MS` the last reading is extrapolated along its trend, and after `FALLBACK_HOLD_MS`
+ * without a reading the load goes to `RELAY_SAFE_LOAD_ON`.
+ */
+void applyRelay() {
+  uint32_t now = clockMs();
+  uint32_t age = now - lastReadingMs;
+  float effective;
+  bool safeState = false;
+  if (percentage >= 0 && age < MONITOR_STALE_MS) {
+    fallbackLogged = false;
+    effective = percentage;
+  } else if (percentage >= 0 && age < FALLBACK_HOLD_MS) {
+    if (!fallbackLogged) {
+      Serial.println("Monitor silent, running on the predicted percentage");
+      fallbackLogged = true;
+    }
+    if (now - lastFallbackSaveMs >= FALLBACK_SAVE_MS) {
+      saveFallback(now);  // Keeps the age, so a reset does not restart the hold time
+    }
+    effective = chargeTrend.predict(percentage, age);
+  } else if (percentage >= 0 || age >= MONITOR_STALE_MS) {
+    safeState = true;
   } else {
-       digitalWrite(LED_PIN, HIGH); // Turn on LED
-    Serial.println("Disconnected from WiFi");
+    return;  // Just booted with nothing cached; give the monitor a chance first
   }
 
-  delay(60000);  // Delay before next check (e.g., 1 minute)
+  for (RelayChannel &channel : channels) {
+    bool changed = safeState ? channel.control.request(RELAY_SAFE_LOAD_ON, now) : channel.control.update(effective, now);
+    if (!changed && channel.written) {
+      continue;
+    }
+    writeRelay(channel, channel.control.loadOn());  // The first decision may keep the control's state but not the pin's
+    channel.written = true;
+    Serial.print("Relay ");
+    Serial.print(channel.deviceId);
+    Serial.print(" switched ");
+    Serial.print(channel.control.loadOn() ? "on" : "off");
+    Serial.print(", switches: ");
+    Serial.println(channel.control.switchCount());
+  }
 }
 
+// Takes in a percentage just heard from the monitor.
+void noteReading() {
+  uint32_t now = clockMs();
+  lastReadingMs = now;
+  chargeTrend.update(percentage, now);
+  saveFallback(now);
+}
 
+/**
+ * The function `saveFallback` writes the last reading, its trend and age, and the cut-offs to RTC
+ * memory, which survives a reset but not a power cycle.
+ */
+void saveFallback(uint32_t now) {
+  if (percentage < 0) {
+    return;
+  }
+  FallbackRecord record = {};
+  record.magic = FALLBACK_MAGIC;
+  record.percentage = percentage;
+  record.trendPerMinute = chargeTrend.perMinuteRate();
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    record.cutOff[i] = channels[i].control.cutOffPercent();
+  }
+  record.ageMs = now - lastReadingMs;
+  record.crc = fallbackCrc(record);
+  ESP.rtcUserMemoryWrite(FALLBACK_RTC_OFFSET, (uint32_t *)&record, sizeof(record));
+  lastFallbackSaveMs = now;
+}
 
-#include <ESP8266WiFi.h>
-#include <ESP8266WebServer.h>
+// Picks up the reading cached before a reset, if there is a valid one.
+void restoreFallback() {
+  FallbackRecord record;
+  if (!ESP.rtcUserMemoryRead(FALLBACK_RTC_OFFSET, (uint32_t *)&record, sizeof(record)) ||
+      !fallbackValid(record)) {
+    Serial.println("No cached reading");
+    return;
+  }
+  uint32_t now = clockMs();
+  percentage = record.percentage;
+  lastReadingMs = now - record.ageMs;
+  chargeTrend.restore(record.percentage, record.trendPerMinute, lastReadingMs);
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    channels[i].control.setCutOff(record.cutOff[i]);
+  }
+  Serial.print("Cached reading: ");
+  Serial.print(percentage);
+  Serial.print("%, ");
+  Serial.print(record.ageMs / 1000);
+  Serial.println(" s old");
+}
 
-ESP8266WebServer server(80);  // Web server running on port 80
+void writeRelay(const RelayChannel &channel, bool loadOn) {
+#ifdef RELAY_DUTY_CYCLE
+  // One low pulse on a coil flips the latch, which then holds without power
+  uint8_t coil = loadOn ? channel.pin : channel.resetPin;
+  digitalWrite(coil, LOW);
+  delay(RELAY_PULSE_MS);
+  digitalWrite(coil, HIGH);
+  relayPulses++;
+#else
+  if (loadOn) {
+    digitalWrite(channel.pin, LOW);  // Turn on relay
+  } else {
+    digitalWrite(channel.pin, HIGH); // Turn off relay
+  }
+#endif
+}
 
-void setup() {
-  Serial.begin(115200);
-  WiFi.softAP("ESP01_Hotspot", "12345678");
+uint32_t clockMs() {
+  return clockBaseMs + millis();
+}
+
+#ifdef RELAY_DUTY_CYCLE
+/**
+ * The function `restoreDuty` picks up the session kept in RTC memory after a wake-up from deep sleep.
+ * On a cold boot it starts a new session and latches the relays in their safe state.
+ */
+void restoreDuty() {
+  ESP.rtcUserMemoryRead(DUTY_RTC_OFFSET, (uint32_t *)&duty, sizeof(duty));
+  if (ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE && dutyValid(duty)) {
+    clockBaseMs = duty.clockMs;
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+      channels[i].control.restore(duty.loadOn[i], duty.lastSwitchMs[i], duty.switches[i]);
+      channels[i].written = true;
+    }
+    return;
+  }
+  memset(&duty, 0, sizeof(duty));
+  duty.magic = DUTY_MAGIC;
+  for (const RelayChannel &channel : channels) {
+    writeRelay(channel, RELAY_SAFE_LOAD_ON);
+  }
+}
+
+/**
+ * The function `dutyCycle` is the whole of `loop()` in duty-cycled mode: connect on the cached access
+ * point, poll once, settle the relay and sleep. The event stream is not used. If WiFi or the monitor
+ * does not answer within `DUTY_AWAKE_LIMIT_MS` the relay runs on the cached reading, as it does when
+ * always awake. Each cycle keeps its awake time and the average current it implies in `duty`, for the
+ * next poll to report.
+ */
+void dutyCycle() {
+  if (serviceWiFi() && !polledOnce) {
+    dutyAnswered = pollDevice();  // A single try; a retry would cost more than waiting for the next cycle
+  }
+  if (!polledOnce && millis() < DUTY_AWAKE_LIMIT_MS) {
+    applyRelay();
+    delay(10);
+    return;
+  }
+  applyRelay();
+
+  uint32_t awakeMs = millis();
+  uint32_t sleepMs = DUTY_SLEEP_MS;
+  if (dutyAnswered && haveSchedule) {
+    int32_t untilSlotMs = (int32_t)(nextPollAtMs - awakeMs);
+    sleepMs = untilSlotMs < DUTY_MIN_SLEEP_MS ? DUTY_MIN_SLEEP_MS : untilSlotMs;
+  }
+  float chargeMas = DUTY_AWAKE_MA * awakeMs + DUTY_SLEEP_MA * sleepMs + RELAY_PULSE_MA * RELAY_PULSE_MS * relayPulses;
+  duty.cycles++;
+  duty.awakeMsTotal += awakeMs;
+  duty.sleepMsTotal += sleepMs;
+  duty.lastAwakeMs = awakeMs;
+  duty.lastAverageUa = chargeMas * 1000 / (awakeMs + sleepMs);
+  duty.clockMs = clockMs() + sleepMs;
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    duty.lastSwitchMs[i] = channels[i].control.lastSwitch();
+    duty.switches[i] = channels[i].control.switchCount();
+    duty.loadOn[i] = channels[i].control.loadOn();
+  }
+  duty.crc = dutyCrc(duty);
+  ESP.rtcUserMemoryWrite(DUTY_RTC_OFFSET, (uint32_t *)&duty, sizeof(duty));
+  saveFallback(duty.clockMs);  // The reading is that much older on waking
 
-  // Start the server
-  server.on("/", handleRoot);  // When accessing the root page
-  server.begin();
-  Serial.println("Web server started.");
+  ESP.deepSleep((uint64_t)sleepMs * 1000);
 }
+#endif
+
+#ifdef RELAY_SESSIONS
+/**
+ * The function `sessionCycle` is the whole of `loop()` in session mode. A session opens when the poll
+ * slot comes up, connects, polls once and closes again, releasing the monitor's softAP for other nodes.
+ * Neither the event stream nor beacons are used, since both need the association kept.
+ */
+void sessionCycle() {
+  processRadio();
+  uint32_t now = millis();
+  if (!sessionOpen && (int32_t)(now - nextSessionMs) >= 0) {
+    sessionOpen = true;
+    sessionStartMs = now;
+    wifiLink.setWanted(true);
+  }
 
-void handleRoot() {
-  server.send(200, "text/html", "<h1>Hello from ESP01!</h1>");
+  if (serviceWiFi() && sessionOpen) {
+    closeSession(pollDevice());
+  } else if (sessionOpen && now - sessionStartMs >= SESSION_LIMIT_MS) {
+    closeSession(false);
+  }
+
+  applyRelay();  // Runs on the cached reading between sessions
+  waitForRadio(10);
 }
 
-void loop() {
-  server.handleClient();  // Handle web requests
+/**
+ * The function `closeSession` lets go of the access point and works out when the next session is due:
+ * the assigned slot after a poll, or `UNSUBSCRIBED_POLL_MS` later if the node never got to poll.
+ */
+void closeSession(bool answered) {
+  uint32_t now = millis();
+  bool polled = (int32_t)(lastPollMs - sessionStartMs) >= 0;
+  nextSessionMs = polled ? nextPollAtMs : now + UNSUBSCRIBED_POLL_MS;
+  if ((int32_t)(nextSessionMs - now) < SESSION_MIN_GAP_MS) {
+    nextSessionMs = now + SESSION_MIN_GAP_MS;
+  }
+  sessionOpen = false;
+  wifiLink.setWanted(false);
+  serviceWiFi();  // Disconnects right away
+
+  sessions++;
+  sessionsAnswered += answered ? 1 : 0;
+  sessionMsTotal += now - sessionStartMs;
+  Serial.print("Session ");
+  Serial.print(sessions);
+  Serial.print(answered ? ": polled" : ": no answer");
+  Serial.print(" in ");
+  Serial.print(now - sessionStartMs);
+  Serial.print(" ms (average ");
+  Serial.print(sessionMsTotal / sessions);
+  Serial.print(" ms, ");
+  Serial.print(sessionsAnswered);
+  Serial.print(" answered), next in ");
+  Serial.print((int32_t)(nextSessionMs - now));
+  Serial.println(" ms");
 }
+#endif
@@ -0,0 +1,99 @@
+#ifdef WIRE_BENCHMARK
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <telemetry_wire.h>
+
+#define WIRE_BENCHMARK_ROUNDS 1000
+
+static void printResult(const char *name, size_t bytes, uint32_t cycles) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(bytes);
+  Serial.print(" bytes, ");
+  Serial.print(cycles / WIRE_BENCHMARK_ROUNDS);
+  Serial.println(" cycles/decode");
+}
+
+/**
+ * The function `runWireBenchmark` times what the relay node decodes on the ESP8266: a `/getVoltageById`
+ * reply in JSON and in MessagePack through the same filter as the poll, and the signed radio and beacon
+ * frames, whose SipHash check is most of their cost on this CPU. It prints the payload size and the
+ * average number of CPU cycles per decode, and only exists in the `esp01_wire_benchmark` environment.
+ */
+void runWireBenchmark() {
+  JsonDocument source;
+  source["percentage"] = 63.5;
+  source["devices"][0]["deviceId"] = "kitchen-fridge";
+  source["devices"][0]["voltage"] = 35;
+  source["pollIntervalMs"] = 60000;
+
+  JsonDocument filter;
+  filter["percentage"] = true;
+  filter["devices"][0]["deviceId"] = true;
+  filter["devices"][0]["voltage"] = true;
+  filter["pollIntervalMs"] = true;
+
+  char json[160];
+  size_t jsonLen = serializeJson(source, json, sizeof(json));
+  uint8_t msgpack[160];
+  size_t msgpackLen = serializeMsgPack(source, msgpack, sizeof(msgpack));
+
+  static const uint8_t key[SIPHASH_KEY_SIZE] = WIRE_RADIO_KEY;
+  WireRadioTelemetryFrame telemetry = {};
+  wireInitHeader(telemetry.header, WIRE_FRAME_RADIO_TELEMETRY, sizeof(telemetry));
+  telemetry.percentageCenti = 6350;
+  telemetry.systemType = 24;
+  wireSign(&telemetry, sizeof(telemetry), key);
+  WireBeaconFrame beacon = {};
+  wireInitHeader(beacon.header, WIRE_FRAME_BEACON, sizeof(beacon));
+  beacon.percentageCenti = 6350;
+  beacon.systemType = 24;
+  wireSign(&beacon, sizeof(beacon), key);
+
+  // `sink` keeps the compiler from dropping the decoded values.
+  volatile float sink = 0;
+  uint32_t start;
+  JsonDocument doc;
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    deserializeJson(doc, json, jsonLen, DeserializationOption::Filter(filter));
+    sink = doc["percentage"].as<float>();
+  }
+  printResult("json", jsonLen, ESP.getCycleCount() - start);
+  yield();  // A thousand rounds can outlast the software watchdog
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    deserializeMsgPack(doc, msgpack, msgpackLen, DeserializationOption::Filter(filter));
+    sink = doc["percentage"].as<float>();
+  }
+  printResult("msgpack", msgpackLen, ESP.getCycleCount() - start);
+  yield();
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    WireRadioTelemetryFrame decoded;
+    if (wireDecode((const uint8_t *)&telemetry, sizeof(telemetry), WIRE_FRAME_RADIO_TELEMETRY, &decoded,
+                   sizeof(decoded)) &&
+        wireVerify(&decoded, sizeof(decoded), key)) {
+      sink = decoded.percentageCenti / 100.0;
+    }
+  }
+  printResult("radio telemetry", sizeof(telemetry), ESP.getCycleCount() - start);
+  yield();
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    WireBeaconFrame decoded;
+    if (wireDecode((const uint8_t *)&beacon, sizeof(beacon), WIRE_FRAME_BEACON, &decoded, sizeof(decoded)) &&
+        wireVerify(&decoded, sizeof(decoded), key)) {
+      sink = decoded.percentageCenti / 100.0;
+    }
+  }
+  printResult("beacon", sizeof(beacon), ESP.getCycleCount() - start);
+  (void)sink;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+// Just enough of the Arduino core for host tests of the headers that build on `Stream`.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Virtual clock; each yield() moves it on a millisecond, so a wait for a stream timeout ends.
+inline uint32_t stubMillis = 0;
+
+inline uint32_t millis() {
+  return stubMillis;
+}
+
+inline void yield() {
+  stubMillis++;
+}
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeoutMs) {
+    timeout = timeoutMs;
+  }
+
+  unsigned long getTimeout() const {
+    return timeout;
+  }
+
+  // Unlike the core's, does not wait itself: the streams under test already do.
+  size_t readBytes(char *buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = read();
+      if (c < 0) {
+        break;
+      }
+      buffer[n++] = (char)c;
+    }
+    return n;
+  }
+
+ protected:
+  unsigned long timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <ArduinoJson.h>
+#include <bounded_stream.h>
+
+// The relay parses the monitor's poll reply straight off the socket through a BoundedStream. These run
+// the same parse against a scripted socket that hands the bytes out in delayed chunks, and count what
+// the JsonDocument allocates.
+
+// A socket whose bytes become readable `chunkSize` at a time, one chunk every `chunkDelayMs`, and
+// stop coming at all after `stallAfter`.
+class ScriptedSocket : public Stream {
+ public:
+  explicit ScriptedSocket(const std::string &data)
+      : data(data), position(0), chunkSize(data.size()), chunkDelayMs(0), stallAfter(data.size()), startMs(millis()) {}
+
+  int available() override {
+    return (int)(released() - position);
+  }
+
+  int read() override {
+    if (position >= released()) {
+      return -1;
+    }
+    return (uint8_t)data[position++];
+  }
+
+  int peek() override {
+    return position < released() ? (uint8_t)data[position] : -1;
+  }
+
+  size_t write(uint8_t) override {
+    return 0;
+  }
+
+  std::string data;
+  size_t position;  // Bytes consumed so far
+  size_t chunkSize;
+  uint32_t chunkDelayMs;
+  size_t stallAfter;
+
+ private:
+  size_t released() {
+    size_t n = chunkDelayMs == 0 ? data.size() : ((millis() - startMs) / chunkDelayMs + 1) * chunkSize;
+    if (n > stallAfter) {
+      n = stallAfter;
+    }
+    return n < data.size() ? n : data.size();
+  }
+
+  uint32_t startMs;
+};
+
+// Tracks the bytes a JsonDocument holds, and the most it held at once.
+class PeakAllocator : public ArduinoJson::Allocator {
+ public:
+  void *allocate(size_t size) override {
+    uint8_t *block = (uint8_t *)malloc(HEADER + size);
+    if (block == NULL) {
+      return NULL;
+    }
+    *(size_t *)block = size;
+    grow(size, 0);
+    return block + HEADER;
+  }
+
+  void deallocate(void *pointer) override {
+    if (pointer != NULL) {
+      uint8_t *block = (uint8_t *)pointer - HEADER;
+      current -= *(size_t *)block;
+      free(block);
+    }
+  }
+
+  void *reallocate(void *pointer, size_t size) override {
+    if (pointer == NULL) {
+      return allocate(size);
+    }
+    uint8_t *block = (uint8_t *)pointer - HEADER;
+    size_t before = *(size_t *)block;
+    block = (uint8_t *)realloc(block, HEADER + size);
+    if (block == NULL) {
+      return NULL;
+    }
+    *(size_t *)block = size;
+    grow(size, before);
+    return block + HEADER;
+  }
+
+  size_t current = 0;
+  size_t peak = 0;
+
+ private:
+  static const size_t HEADER = alignof(max_align_t);  // Where the block's size is kept
+
+  void grow(size_t size, size_t before) {
+    current += size - before;
+    if (current > peak) {
+      peak = current;
+    }
+  }
+};
+
+// MessagePack encoding of the handful of types in the reply.
+
+static void packBigEndian(std::string &out, uint32_t value, int bytes) {
+  for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+    out += (char)(value >> shift);
+  }
+}
+
+static void packString(std::string &out, const char *value) {
+  size_t length = strlen(value);
+  out += (char)(0xa0 | length);  // Fixstr; every string here is under 32 bytes
+  out.append(value, length);
+}
+
+static void packFloat(std::string &out, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  out += (char)0xca;
+  packBigEndian(out, bits, 4);
+}
+
+static void packUint(std::string &out, uint32_t value) {
+  out += (char)0xce;
+  packBigEndian(out, value, 4);
+}
+
+/**
+ * The poll reply as the monitor sends it, plus `historySize` floats under a key the relay does not
+ * ask for, standing in for whatever a newer monitor might add.
+ */
+static std::string pollReply(size_t historySize) {
+  std::string out;
+  out += (char)0x84;  // Map of 4
+  packString(out, "percentage");
+  packFloat(out, 63.5f);
+  packString(out, "devices");
+  out += (char)0x91;  // Array of 1
+  out += (char)0x82;  // Map of 2
+  packString(out, "deviceId");
+  packString(out, "relay-1");
+  packString(out, "voltage");
+  packFloat(out, 12.6f);
+  packString(out, "pollIntervalMs");
+  packUint(out, 60000);
+  packString(out, "history");
+  out += (char)0xdc;  // Array 16
+  packBigEndian(out, historySize, 2);
+  for (size_t i = 0; i < historySize; i++) {
+    packFloat(out, 12.0f + i % 10 / 10.0f);
+  }
+  return out;
+}
+
+static const char *nextResponse = "HTTP/1.1 200 OK\r\n";
+
+static JsonDocument pollFilter;  // The relay's own
+
+void setUp() {
+  stubMillis = 1000;
+  pollFilter.clear();
+  pollFilter["percentage"] = true;
+  pollFilter["devices"][0]["deviceId"] = true;
+  pollFilter["devices"][0]["voltage"] = true;
+  pollFilter["pollIntervalMs"] = true;
+  pollFilter["nextPollMs"] = true;
+}
+
+void tearDown() {}
+
+static DeserializationError parse(Stream &stream, JsonDocument &doc) {
+  return deserializeMsgPack(doc, stream, DeserializationOption::Filter(pollFilter));
+}
+
+void test_stops_at_content_length() {
+  std::string body = pollReply(4);
+  ScriptedSocket socket(body + nextResponse);
+  BoundedStream stream(socket, body.size());
+  JsonDocument doc;
+
+  TEST_ASSERT_FALSE(parse(stream, doc));
+  TEST_ASSERT_EQUAL_UINT32(0, stream.remaining());
+  TEST_ASSERT_EQUAL_UINT32(body.size(), socket.position);  // The next response is left on the socket
+  TEST_ASSERT_EQUAL_FLOAT(63.5f, doc["percentage"].as<float>());
+  TEST_ASSERT_EQUAL_STRING("relay-1", doc["devices"][0]["deviceId"].as<const char *>());
+  TEST_ASSERT_EQUAL_UINT32(60000, doc["pollIntervalMs"].as<uint32_t>());
+  TEST_ASSERT_TRUE(doc["history"].isNull());
+  TEST_ASSERT_EQUAL_INT(-1, stream.read());
+  TEST_ASSERT_EQUAL_INT(-1, stream.peek());
+}
+
+void test_waits_for_each_chunk() {
+  std::string body = pollReply(40);
+  ScriptedSocket socket(body + nextResponse);
+  socket.chunkSize = 7;
+  socket.chunkDelayMs = 20;
+  socket.setTimeout(100);
+  BoundedStream stream(socket, body.size());
+  JsonDocument doc;
+
+  TEST_ASSERT_EQUAL_INT(7, stream.available());
+  TEST_ASSERT_FALSE(parse(stream, doc));
+  TEST_ASSERT_EQUAL_UINT32(0, stream.remaining());
+  TEST_ASSERT_EQUAL_UINT32(body.size(), socket.position);
+  TEST_ASSERT_EQUAL_FLOAT(12.6f, doc["devices"][0]["voltage"].as<float>());
+}
+
+void test_available_never_exceeds_the_body() {
+  ScriptedSocket socket(std::string("abc") + nextResponse);
+  BoundedStream stream(socket, 3);
+
+  TEST_ASSERT_EQUAL_INT(3, stream.available());
+  TEST_ASSERT_EQUAL_INT('a', stream.peek());
+  TEST_ASSERT_EQUAL_INT('a', stream.read());
+  TEST_ASSERT_EQUAL_INT(2, stream.available());
+}
+
+void test_stalled_body_times_out() {
+  std::string body = pollReply(40);
+  ScriptedSocket socket(body);
+  socket.stallAfter = body.size() / 2;
+  socket.setTimeout(100);
+  BoundedStream stream(socket, body.size());
+  JsonDocument doc;
+
+  uint32_t startMs = millis();
+  TEST_ASSERT_EQUAL(DeserializationError::IncompleteInput, parse(stream, doc).code());
+  // Left unread, which makes the relay drop the connection
+  TEST_ASSERT_EQUAL_UINT32(body.size() - socket.stallAfter, stream.remaining());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(200, millis() - startMs);  // One timeout, not one per byte left
+}
+
+void test_short_content_length_truncates() {
+  std::string body = pollReply(4);
+  ScriptedSocket socket(body);
+  BoundedStream stream(socket, 10);
+  JsonDocument doc;
+
+  TEST_ASSERT_EQUAL(DeserializationError::IncompleteInput, parse(stream, doc).code());
+  TEST_ASSERT_EQUAL_UINT32(10, socket.position);
+}
+
+void test_peak_memory_does_not_grow_with_ignored_fields() {
+  std::string small = pollReply(0);
+  std::string large = pollReply(4000);  // 20 KB, far more than an ESP-01 could buffer
+  TEST_ASSERT_GREATER_THAN_UINT32(20000, large.size());
+
+  PeakAllocator smallAllocator;
+  ScriptedSocket smallSocket(small);
+  BoundedStream smallStream(smallSocket, small.size());
+  JsonDocument smallDoc(&smallAllocator);
+  TEST_ASSERT_FALSE(parse(smallStream, smallDoc));
+
+  PeakAllocator largeAllocator;
+  ScriptedSocket largeSocket(large);
+  largeSocket.chunkSize = 1460;  // A TCP segment at a time
+  largeSocket.chunkDelayMs = 5;
+  BoundedStream largeStream(largeSocket, large.size());
+  JsonDocument largeDoc(&largeAllocator);
+  TEST_ASSERT_FALSE(parse(largeStream, largeDoc));
+
+  TEST_ASSERT_EQUAL_UINT32(0, largeStream.remaining());
+  TEST_ASSERT_EQUAL_UINT32(smallAllocator.peak, largeAllocator.peak);
+  TEST_ASSERT_LESS_THAN_UINT32(large.size() / 2, largeAllocator.peak);
+  TEST_ASSERT_EQUAL_FLOAT(63.5f, largeDoc["percentage"].as<float>());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_stops_at_content_length);
+  RUN_TEST(test_waits_for_each_chunk);
+  RUN_TEST(test_available_never_exceeds_the_body);
+  RUN_TEST(test_stalled_body_times_out);
+  RUN_TEST(test_short_content_length_truncates);
+  RUN_TEST(test_peak_memory_does_not_grow_with_ignored_fields);
+  return UNITY_END();
+}
@@ -0,0 +1,180 @@
+#include <unity.h>
+#include <loopback_transport.h>
+#include <telemetry_wire.h>
+
+// The monitor's and a relay node's radio frame handling run against each other over a LoopbackBus: the
+// monitor signs telemetry, the node checks it the way control_switch's main.cpp does and acknowledges
+// it with a signed relay state frame.
+
+static const uint8_t key[SIPHASH_KEY_SIZE] = WIRE_RADIO_KEY;
+static const uint8_t monitorAddress[TRANSPORT_ADDRESS_SIZE] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+static const uint8_t nodeAddress[TRANSPORT_ADDRESS_SIZE] = {0x5c, 0xcf, 0x7f, 0x00, 0x00, 0x02};
+static const uint32_t epoch = 0x5EED1234;
+
+struct Node {
+  LoopbackTransport *transport;
+  WireReplayWindow replay;
+  uint32_t received;
+  uint32_t accepted;
+  uint16_t percentageCenti;
+};
+
+struct Monitor {
+  uint32_t acks;
+  uint32_t lastAckSeq;
+  uint8_t lastAckFrom[TRANSPORT_ADDRESS_SIZE];
+};
+
+static LoopbackBus bus;
+static Node node;
+static Monitor monitor;
+static LoopbackTransport *monitorTransport;
+static LoopbackTransport *nodeTransport;
+
+static void nodeReceive(void *context, const uint8_t *from, const uint8_t *data, size_t len) {
+  Node &self = *(Node *)context;
+  self.received++;
+  WireRadioTelemetryFrame frame;
+  if (!wireDecode(data, len, WIRE_FRAME_RADIO_TELEMETRY, &frame, sizeof(frame)) ||
+      !wireVerify(&frame, sizeof(frame), key) || !self.replay.accept(frame.epoch, frame.seq)) {
+    return;
+  }
+  self.accepted++;
+  self.percentageCenti = frame.percentageCenti;
+
+  WireRadioRelayStateFrame ack = {};
+  wireInitHeader(ack.header, WIRE_FRAME_RADIO_RELAY_STATE, sizeof(ack));
+  ack.epoch = frame.epoch;
+  ack.seq = frame.seq;
+  ack.channels = 1;
+  ack.loadOnMask = frame.percentageCenti > 3000 ? 1 : 0;
+  wireSign(&ack, sizeof(ack), key);
+  self.transport->send(from, (const uint8_t *)&ack, sizeof(ack));
+}
+
+static void monitorReceive(void *context, const uint8_t *from, const uint8_t *data, size_t len) {
+  Monitor &self = *(Monitor *)context;
+  WireRadioRelayStateFrame ack;
+  if (!wireDecode(data, len, WIRE_FRAME_RADIO_RELAY_STATE, &ack, sizeof(ack)) || !wireVerify(&ack, sizeof(ack), key)) {
+    return;
+  }
+  self.acks++;
+  self.lastAckSeq = ack.seq;
+  memcpy(self.lastAckFrom, from, TRANSPORT_ADDRESS_SIZE);
+}
+
+static WireRadioTelemetryFrame telemetryFrame(uint32_t seq, uint16_t percentageCenti) {
+  WireRadioTelemetryFrame frame = {};
+  wireInitHeader(frame.header, WIRE_FRAME_RADIO_TELEMETRY, sizeof(frame));
+  frame.epoch = epoch;
+  frame.seq = seq;
+  frame.percentageCenti = percentageCenti;
+  frame.systemType = 12;
+  wireSign(&frame, sizeof(frame), key);
+  return frame;
+}
+
+static bool broadcast(LoopbackTransport &transport, const WireRadioTelemetryFrame &frame) {
+  return transport.send(NULL, (const uint8_t *)&frame, sizeof(frame));
+}
+
+void setUp() {
+  bus = LoopbackBus{};
+  node = Node{};
+  monitor = Monitor{};
+  monitorTransport = new LoopbackTransport(bus, monitorAddress);
+  nodeTransport = new LoopbackTransport(bus, nodeAddress);
+  TEST_ASSERT_TRUE(monitorTransport->begin());
+  TEST_ASSERT_TRUE(nodeTransport->begin());
+  node.transport = nodeTransport;
+  nodeTransport->onReceive(nodeReceive, &node);
+  monitorTransport->onReceive(monitorReceive, &monitor);
+}
+
+void tearDown() {
+  delete monitorTransport;
+  delete nodeTransport;
+}
+
+void test_signed_frame_is_accepted_and_acknowledged() {
+  TEST_ASSERT_TRUE(broadcast(*monitorTransport, telemetryFrame(1, 6350)));
+
+  TEST_ASSERT_EQUAL_UINT32(1, node.accepted);
+  TEST_ASSERT_EQUAL_UINT32(6350, node.percentageCenti);
+  TEST_ASSERT_EQUAL_UINT32(1, monitor.acks);
+  TEST_ASSERT_EQUAL_UINT32(1, monitor.lastAckSeq);
+  TEST_ASSERT_EQUAL_MEMORY(nodeAddress, monitor.lastAckFrom, TRANSPORT_ADDRESS_SIZE);
+}
+
+void test_tampered_frame_is_rejected() {
+  WireRadioTelemetryFrame frame = telemetryFrame(1, 1000);
+  frame.percentageCenti = 9900;  // Changed after signing
+  broadcast(*monitorTransport, frame);
+
+  WireRadioTelemetryFrame forged = telemetryFrame(2, 1000);
+  forged.tag[0] ^= 1;
+  broadcast(*monitorTransport, forged);
+
+  TEST_ASSERT_EQUAL_UINT32(2, node.received);
+  TEST_ASSERT_EQUAL_UINT32(0, node.accepted);
+  TEST_ASSERT_EQUAL_UINT32(0, monitor.acks);
+}
+
+void test_replayed_frame_is_rejected() {
+  WireRadioTelemetryFrame first = telemetryFrame(1, 6000);
+  broadcast(*monitorTransport, first);
+  broadcast(*monitorTransport, telemetryFrame(2, 5000));
+  broadcast(*monitorTransport, first);  // Recorded and sent again
+  broadcast(*monitorTransport, telemetryFrame(2, 5000));
+
+  TEST_ASSERT_EQUAL_UINT32(4, node.received);
+  TEST_ASSERT_EQUAL_UINT32(2, node.accepted);
+  TEST_ASSERT_EQUAL_UINT32(5000, node.percentageCenti);
+  TEST_ASSERT_EQUAL_UINT32(2, monitor.acks);
+}
+
+void test_truncated_and_oversized_frames() {
+  WireRadioTelemetryFrame frame = telemetryFrame(1, 6000);
+  monitorTransport->send(NULL, (const uint8_t *)&frame, sizeof(frame) - 1);
+  TEST_ASSERT_EQUAL_UINT32(1, node.received);
+  TEST_ASSERT_EQUAL_UINT32(0, node.accepted);
+
+  uint8_t oversized[LOOPBACK_MAX_FRAME + 1] = {};
+  TEST_ASSERT_FALSE(monitorTransport->send(NULL, oversized, sizeof(oversized)));
+  TEST_ASSERT_EQUAL_UINT32(1, node.received);
+}
+
+void test_lost_frames_are_skipped_not_replayed() {
+  bus.dropEvery = 3;
+  for (uint32_t seq = 1; seq <= 9; seq++) {
+    TEST_ASSERT_TRUE(broadcast(*monitorTransport, telemetryFrame(seq, 5000 + seq)));
+  }
+
+  // Acks count on the bus too, so every third frame is telemetry 2, 4, 6 and 8; the node takes the
+  // rest even with the gaps in the sequence
+  TEST_ASSERT_EQUAL_UINT32(5, node.received);
+  TEST_ASSERT_EQUAL_UINT32(5, node.accepted);
+  TEST_ASSERT_EQUAL_UINT32(5, monitor.acks);
+  TEST_ASSERT_EQUAL_UINT32(9, monitor.lastAckSeq);
+}
+
+void test_unicast_reaches_only_its_address() {
+  static const uint8_t otherAddress[TRANSPORT_ADDRESS_SIZE] = {0x5c, 0xcf, 0x7f, 0x00, 0x00, 0x03};
+  WireRadioTelemetryFrame frame = telemetryFrame(1, 6000);
+  monitorTransport->send(otherAddress, (const uint8_t *)&frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT32(0, node.received);
+
+  monitorTransport->send(nodeAddress, (const uint8_t *)&frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT32(1, node.accepted);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_signed_frame_is_accepted_and_acknowledged);
+  RUN_TEST(test_tampered_frame_is_rejected);
+  RUN_TEST(test_replayed_frame_is_rejected);
+  RUN_TEST(test_truncated_and_oversized_frames);
+  RUN_TEST(test_lost_frames_are_skipped_not_replayed);
+  RUN_TEST(test_unicast_reaches_only_its_address);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#include <unity.h>
+#include <telemetry_wire.h>
+
+// The relay node keeps one replay window per transport, since the monitor numbers its ESP-NOW frames and
+// its UDP beacons separately and the two can arrive in either order.
+
+static const uint8_t key[SIPHASH_KEY_SIZE] = WIRE_RADIO_KEY;
+static const uint32_t epoch = 0x5EED1234;
+
+static WireReplayWindow radioReplay;
+static WireReplayWindow beaconReplay;
+static uint32_t monitorEpoch;
+
+void setUp() {
+  radioReplay = WireReplayWindow{};
+  beaconReplay = WireReplayWindow{};
+  monitorEpoch = 0;
+}
+
+void tearDown() {}
+
+static WireRadioTelemetryFrame telemetryFrame(uint32_t seq, uint32_t frameEpoch = epoch) {
+  WireRadioTelemetryFrame frame = {};
+  wireInitHeader(frame.header, WIRE_FRAME_RADIO_TELEMETRY, sizeof(frame));
+  frame.epoch = frameEpoch;
+  frame.seq = seq;
+  frame.percentageCenti = 6350;
+  wireSign(&frame, sizeof(frame), key);
+  return frame;
+}
+
+static WireBeaconFrame beaconFrame(uint32_t seq, uint32_t frameEpoch = epoch) {
+  WireBeaconFrame frame = {};
+  wireInitHeader(frame.header, WIRE_FRAME_BEACON, sizeof(frame));
+  frame.epoch = frameEpoch;
+  frame.seq = seq;
+  frame.percentageCenti = 6350;
+  wireSign(&frame, sizeof(frame), key);
+  return frame;
+}
+
+// As acceptRadioFrame in main.cpp: a boot seen on either transport rules out earlier ones on both.
+static bool accept(WireReplayWindow &window, uint32_t frameEpoch, uint32_t frameSeq) {
+  if (frameEpoch < monitorEpoch || !window.accept(frameEpoch, frameSeq)) {
+    return false;
+  }
+  monitorEpoch = frameEpoch;
+  return true;
+}
+
+// What the relay does with each frame type, minus handling the contents.
+static bool receiveTelemetry(const WireRadioTelemetryFrame &sent) {
+  WireRadioTelemetryFrame frame;
+  return wireDecode((const uint8_t *)&sent, sizeof(sent), WIRE_FRAME_RADIO_TELEMETRY, &frame, sizeof(frame)) &&
+         wireVerify(&frame, sizeof(frame), key) && accept(radioReplay, frame.epoch, frame.seq);
+}
+
+static bool receiveBeacon(const WireBeaconFrame &sent) {
+  WireBeaconFrame frame;
+  return wireDecode((const uint8_t *)&sent, sizeof(sent), WIRE_FRAME_BEACON, &frame, sizeof(frame)) &&
+         wireVerify(&frame, sizeof(frame), key) && accept(beaconReplay, frame.epoch, frame.seq);
+}
+
+void test_beacon_ahead_of_telemetry_keeps_both() {
+  // The beacon carries a higher number than the telemetry frame and overtakes it
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(8)));
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(5)));
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(6)));
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(9)));
+}
+
+void test_telemetry_ahead_of_beacon_keeps_both() {
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(40)));
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(3)));
+}
+
+void test_replays_are_dropped_per_transport() {
+  WireRadioTelemetryFrame telemetry = telemetryFrame(5);
+  WireBeaconFrame beacon = beaconFrame(5);
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetry));
+  TEST_ASSERT_TRUE(receiveBeacon(beacon));
+  TEST_ASSERT_FALSE(receiveTelemetry(telemetry));
+  TEST_ASSERT_FALSE(receiveBeacon(beacon));
+  TEST_ASSERT_FALSE(receiveTelemetry(telemetryFrame(4)));
+  TEST_ASSERT_FALSE(receiveBeacon(beaconFrame(2)));
+}
+
+void test_new_epoch_restarts_the_sequence() {
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch, 1000));
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch + 1, 1));  // The monitor restarted
+  TEST_ASSERT_FALSE(radioReplay.accept(epoch + 1, 1));
+}
+
+void test_earlier_epoch_is_refused_for_good() {
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch, 1000));
+  TEST_ASSERT_FALSE(radioReplay.accept(epoch - 1, 1));
+  TEST_ASSERT_FALSE(radioReplay.accept(epoch - 1, 2000));
+  TEST_ASSERT_FALSE(radioReplay.accept(0, 1));
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch, 1001));
+}
+
+void test_stale_telemetry_interleaved_with_live_frames() {
+  // Frames recorded during the monitor's previous boot, sent between the live ones
+  WireRadioTelemetryFrame stale[] = {telemetryFrame(700, epoch - 1), telemetryFrame(800, epoch - 1)};
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(10)));
+  for (uint32_t i = 0; i < 20; i++) {
+    TEST_ASSERT_FALSE(receiveTelemetry(stale[i % 2]));
+    TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(11 + i)));
+  }
+  TEST_ASSERT_EQUAL_UINT32(epoch, radioReplay.epoch);
+  TEST_ASSERT_EQUAL_UINT32(30, radioReplay.seq);
+}
+
+void test_stale_beacons_interleaved_with_live_ones() {
+  WireBeaconFrame stale = beaconFrame(900, epoch - 3);
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(1)));
+  for (uint32_t i = 0; i < 20; i++) {
+    TEST_ASSERT_FALSE(receiveBeacon(stale));
+    TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(2 + i)));
+  }
+}
+
+void test_epoch_seen_on_one_transport_guards_the_other() {
+  // No beacon yet, but ESP-NOW already showed the current boot
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(3)));
+  TEST_ASSERT_FALSE(receiveBeacon(beaconFrame(50, epoch - 1)));
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(1)));
+
+  // And a newer boot on the beacons rules out the old one on ESP-NOW
+  TEST_ASSERT_TRUE(receiveBeacon(beaconFrame(1, epoch + 1)));
+  TEST_ASSERT_FALSE(receiveTelemetry(telemetryFrame(4)));
+  TEST_ASSERT_TRUE(receiveTelemetry(telemetryFrame(1, epoch + 1)));
+}
+
+void test_sequence_wraps_around() {
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch, 0xFFFFFFFE));
+  TEST_ASSERT_TRUE(radioReplay.accept(epoch, 1));
+  TEST_ASSERT_FALSE(radioReplay.accept(epoch, 0xFFFFFFFF));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_beacon_ahead_of_telemetry_keeps_both);
+  RUN_TEST(test_telemetry_ahead_of_beacon_keeps_both);
+  RUN_TEST(test_replays_are_dropped_per_transport);
+  RUN_TEST(test_new_epoch_restarts_the_sequence);
+  RUN_TEST(test_earlier_epoch_is_refused_for_good);
+  RUN_TEST(test_stale_telemetry_interleaved_with_live_frames);
+  RUN_TEST(test_stale_beacons_interleaved_with_live_ones);
+  RUN_TEST(test_epoch_seen_on_one_transport_guards_the_other);
+  RUN_TEST(test_sequence_wraps_around);
+  return UNITY_END();
+}
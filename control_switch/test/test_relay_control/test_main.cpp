@@ -0,0 +1,126 @@
+#include <unity.h>
+#include <relay_control.h>
+
+// Synthetic charge traces driven through RelayControl a reading every 10 s, as the node's poll loop
+// would, checking how often the load switches and how long each state lasts.
+
+static const RelayControlConfig config = {5.0f, 60000, 300000};  // 5 %, 1 min on, 5 min off
+static const float cutOff = 30.0f;
+static const uint32_t stepMs = 10000;
+
+static uint32_t switchTimes[64];
+static bool switchedOn[64];
+static uint32_t switches;
+
+void setUp() {
+  switches = 0;
+}
+
+void tearDown() {}
+
+static void feed(RelayControl &relay, float percent, uint32_t nowMs) {
+  if (relay.update(percent, nowMs) && switches < 64) {
+    switchTimes[switches] = nowMs;
+    switchedOn[switches] = relay.loadOn();
+    switches++;
+  }
+}
+
+// Checks that every state lasted at least its minimum time before the next switch.
+static void assertDwellTimes() {
+  for (uint32_t i = 1; i < switches; i++) {
+    uint32_t dwellMs = switchTimes[i] - switchTimes[i - 1];
+    uint32_t minimumMs = switchedOn[i - 1] ? config.minOnMs : config.minOffMs;
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(minimumMs, dwellMs);
+  }
+}
+
+// Deterministic +-1.5 % of sensor noise.
+static float noise(uint32_t step) {
+  static const float pattern[] = {0.0f, 1.5f, -1.0f, 0.5f, -1.5f, 1.0f, -0.5f};
+  return pattern[step % 7];
+}
+
+void test_noisy_daily_cycles_switch_twice_each() {
+  RelayControl relay(config, cutOff);
+  // Three days of discharging 80 -> 20 % over 12 h and charging back over the next 12 h
+  uint32_t step = 0;
+  for (uint32_t day = 0; day < 3; day++) {
+    for (uint32_t i = 0; i < 4320; i++, step++) {
+      float base = i < 2160 ? 80.0f - 60.0f * i / 2160 : 20.0f + 60.0f * (i - 2160) / 2160;
+      feed(relay, base + noise(step), step * stepMs);
+    }
+  }
+
+  // Noise around the cut-off never toggles the load back; only the hysteresis band does
+  TEST_ASSERT_EQUAL_UINT32(6, switches);
+  TEST_ASSERT_EQUAL_UINT32(6, relay.switchCount());
+  for (uint32_t i = 0; i < switches; i++) {
+    TEST_ASSERT_EQUAL(i % 2 == 1, switchedOn[i]);
+  }
+  TEST_ASSERT_TRUE(relay.loadOn());
+  assertDwellTimes();
+}
+
+void test_flapping_charge_is_held_to_minimum_dwell() {
+  RelayControl relay(config, cutOff);
+  // A charger cycling on and off every 10 s swings the reading across the whole band each step
+  for (uint32_t step = 0; step < 360; step++) {
+    feed(relay, step % 2 ? 40.0f : 25.0f, step * stepMs);
+  }
+
+  // Off at 0 s, then every 380 s: back on after 310 s (5 min, up to the next high reading) and off
+  // again 70 s later (1 min, up to the next low one). That is 10 offs and 9 ons in an hour, against 360
+  // switches without the minimum times.
+  TEST_ASSERT_EQUAL_UINT32(19, switches);
+  TEST_ASSERT_EQUAL_UINT32(19, relay.switchCount());
+  TEST_ASSERT_EQUAL_UINT32(310000, switchTimes[1]);
+  TEST_ASSERT_EQUAL_UINT32(380000, switchTimes[2]);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, relay.deferredCount());
+  assertDwellTimes();
+}
+
+void test_first_reading_decides_right_away() {
+  RelayControl relay(config, cutOff);
+  feed(relay, 10.0f, 5000);
+  TEST_ASSERT_EQUAL_UINT32(1, switches);
+  TEST_ASSERT_FALSE(relay.loadOn());
+
+  // The minimum off time counts from that first decision
+  feed(relay, 90.0f, 5000 + config.minOffMs - 1);
+  TEST_ASSERT_FALSE(relay.loadOn());
+  feed(relay, 90.0f, 5000 + config.minOffMs);
+  TEST_ASSERT_TRUE(relay.loadOn());
+  assertDwellTimes();
+}
+
+void test_restored_state_keeps_its_dwell_time() {
+  RelayControl relay(config, cutOff);
+  // Woke from deep sleep 2 min after the load was cut
+  relay.restore(false, 1000, 7);
+  feed(relay, 90.0f, 1000 + 120000);
+  TEST_ASSERT_FALSE(relay.loadOn());
+  feed(relay, 90.0f, 1000 + config.minOffMs);
+  TEST_ASSERT_TRUE(relay.loadOn());
+  TEST_ASSERT_EQUAL_UINT32(8, relay.switchCount());
+}
+
+void test_switches_across_millis_wraparound() {
+  RelayControl relay(config, cutOff);
+  uint32_t start = 0xFFFFFFFF - 100000;
+  feed(relay, 20.0f, start);
+  feed(relay, 90.0f, start + config.minOffMs - stepMs);
+  TEST_ASSERT_FALSE(relay.loadOn());
+  feed(relay, 90.0f, start + config.minOffMs);
+  TEST_ASSERT_TRUE(relay.loadOn());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_noisy_daily_cycles_switch_twice_each);
+  RUN_TEST(test_flapping_charge_is_held_to_minimum_dwell);
+  RUN_TEST(test_first_reading_decides_right_away);
+  RUN_TEST(test_restored_state_keeps_its_dwell_time);
+  RUN_TEST(test_switches_across_millis_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+#ifndef ESPNOW_TRANSPORT_H
+#define ESPNOW_TRANSPORT_H
+
+#include <string.h>
+
+#include "transport.h"
+
+#if defined(ESP32)
+#include <WiFi.h>
+#include <esp_now.h>
+#elif defined(ESP8266)
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#endif
+
+#define ESPNOW_MAX_FRAME 250
+
+/**
+ * `Transport` over ESP-NOW: single frames straight between radios, no association, IP or TCP, so a
+ * frame is typically on the other side within a couple of milliseconds. Runs alongside the regular
+ * WiFi connection on the same channel, so the monitor keeps its softAP and the relay nodes their
+ * station link. Peers are added on first use.
+ *
+ * ESP-NOW takes one receive callback per device, so there can only be one instance.
+ */
+class EspNowTransport : public Transport {
+ public:
+  EspNowTransport() {}
+
+  bool begin() override {
+    instance = this;
+#if defined(ESP32)
+    if (esp_now_init() != ESP_OK) {
+      return false;
+    }
+    return esp_now_register_recv_cb(onReceiveStatic) == ESP_OK;
+#elif defined(ESP8266)
+    if (esp_now_init() != 0) {
+      return false;
+    }
+    esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+    return esp_now_register_recv_cb(onReceiveStatic) == 0;
+#else
+    return false;
+#endif
+  }
+
+  bool send(const uint8_t *to, const uint8_t *data, size_t len) override {
+    static const uint8_t broadcast[TRANSPORT_ADDRESS_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t peer[TRANSPORT_ADDRESS_SIZE];
+    memcpy(peer, to != NULL ? to : broadcast, sizeof(peer));
+    if (len > ESPNOW_MAX_FRAME || !addPeer(peer)) {
+      return false;
+    }
+#if defined(ESP32)
+    return esp_now_send(peer, data, len) == ESP_OK;
+#elif defined(ESP8266)
+    return esp_now_send(peer, (uint8_t *)data, len) == 0;
+#else
+    return false;
+#endif
+  }
+
+  size_t maxFrameSize() const override {
+    return ESPNOW_MAX_FRAME;
+  }
+
+ private:
+  bool addPeer(uint8_t *peer) {
+#if defined(ESP32)
+    if (esp_now_is_peer_exist(peer)) {
+      return true;
+    }
+    esp_now_peer_info_t info = {};
+    memcpy(info.peer_addr, peer, TRANSPORT_ADDRESS_SIZE);
+    info.channel = 0;  // Whatever channel the interface is on
+    info.ifidx = (WiFi.getMode() & WIFI_MODE_AP) ? WIFI_IF_AP : WIFI_IF_STA;
+    return esp_now_add_peer(&info) == ESP_OK;
+#elif defined(ESP8266)
+    if (esp_now_is_peer_exist(peer) > 0) {
+      return true;
+    }
+    return esp_now_add_peer(peer, ESP_NOW_ROLE_COMBO, WiFi.channel(), NULL, 0) == 0;
+#else
+    return false;
+#endif
+  }
+
+#if defined(ESP32) && ESP_IDF_VERSION_MAJOR >= 5
+  static void onReceiveStatic(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+    if (instance != NULL) {
+      instance->deliver(info->src_addr, data, len);
+    }
+  }
+#elif defined(ESP32)
+  static void onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len) {
+    if (instance != NULL) {
+      instance->deliver(mac, data, len);
+    }
+  }
+#elif defined(ESP8266)
+  static void onReceiveStatic(uint8_t *mac, uint8_t *data, uint8_t len) {
+    if (instance != NULL) {
+      instance->deliver(mac, data, len);
+    }
+  }
+#endif
+
+  static EspNowTransport *instance;
+};
+
+// Header-only, so the one definition is left to the linker.
+__attribute__((weak)) EspNowTransport *EspNowTransport::instance = NULL;
+
+#endif
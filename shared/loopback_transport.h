@@ -0,0 +1,66 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <string.h>
+
+#include "transport.h"
+
+#define LOOPBACK_MAX_ENDPOINTS 8
+#define LOOPBACK_MAX_FRAME 250  // Same as ESP-NOW
+
+class LoopbackTransport;
+
+// A shared medium for LoopbackTransport endpoints in one process.
+struct LoopbackBus {
+  LoopbackTransport *endpoints[LOOPBACK_MAX_ENDPOINTS];
+  size_t count;
+  uint32_t dropEvery;  // Loses every n-th frame when non-zero, to exercise retries and timeouts
+  uint32_t sent;
+};
+
+/**
+ * In-process `Transport`: frames sent on one endpoint are delivered synchronously to the others on the
+ * same bus. Lets the monitor's and relay node's frame handling run against each other on a host,
+ * without radios.
+ */
+class LoopbackTransport : public Transport {
+ public:
+  LoopbackTransport(LoopbackBus &bus, const uint8_t address[TRANSPORT_ADDRESS_SIZE]) : bus(bus) {
+    memcpy(this->address, address, TRANSPORT_ADDRESS_SIZE);
+  }
+
+  bool begin() override {
+    if (bus.count >= LOOPBACK_MAX_ENDPOINTS) {
+      return false;
+    }
+    bus.endpoints[bus.count++] = this;
+    return true;
+  }
+
+  bool send(const uint8_t *to, const uint8_t *data, size_t len) override {
+    if (len > LOOPBACK_MAX_FRAME) {
+      return false;
+    }
+    bus.sent++;
+    if (bus.dropEvery != 0 && bus.sent % bus.dropEvery == 0) {
+      return true;  // Lost on the way, as far as the sender can tell
+    }
+    for (size_t i = 0; i < bus.count; i++) {
+      LoopbackTransport *peer = bus.endpoints[i];
+      if (peer != this && (to == NULL || memcmp(to, peer->address, TRANSPORT_ADDRESS_SIZE) == 0)) {
+        peer->deliver(address, data, len);
+      }
+    }
+    return true;
+  }
+
+  size_t maxFrameSize() const override {
+    return LOOPBACK_MAX_FRAME;
+  }
+
+ private:
+  LoopbackBus &bus;
+  uint8_t address[TRANSPORT_ADDRESS_SIZE];
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIPHASH_KEY_SIZE 16
+
+#define SIPHASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+inline void sipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+  v0 += v1;
+  v1 = SIPHASH_ROTL(v1, 13);
+  v1 ^= v0;
+  v0 = SIPHASH_ROTL(v0, 32);
+  v2 += v3;
+  v3 = SIPHASH_ROTL(v3, 16);
+  v3 ^= v2;
+  v0 += v3;
+  v3 = SIPHASH_ROTL(v3, 21);
+  v3 ^= v0;
+  v2 += v1;
+  v1 = SIPHASH_ROTL(v1, 17);
+  v1 ^= v2;
+  v2 = SIPHASH_ROTL(v2, 32);
+}
+
+inline uint64_t sipLoad64(const uint8_t *p) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+/**
+ * SipHash-2-4 of `data` under a 128-bit key: a keyed MAC short enough to sign radio frames, and cheap
+ * enough for an ESP8266 to check every frame it hears.
+ */
+inline uint64_t siphash24(const uint8_t key[SIPHASH_KEY_SIZE], const void *data, size_t length) {
+  const uint8_t *in = (const uint8_t *)data;
+  uint64_t k0 = sipLoad64(key);
+  uint64_t k1 = sipLoad64(key + 8);
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+  size_t whole = length - length % 8;
+  for (size_t i = 0; i < whole; i += 8) {
+    uint64_t m = sipLoad64(in + i);
+    v3 ^= m;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  uint64_t last = (uint64_t)length << 56;
+  for (size_t i = 0; i < length % 8; i++) {
+    last |= (uint64_t)in[whole + i] << (8 * i);
+  }
+  v3 ^= last;
+  sipRound(v0, v1, v2, v3);
+  sipRound(v0, v1, v2, v3);
+  v0 ^= last;
+
+  v2 ^= 0xff;
+  for (int i = 0; i < 4; i++) {
+    sipRound(v0, v1, v2, v3);
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPHASH_ROTL
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef TELEMETRY_WIRE_H
+#define TELEMETRY_WIRE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "siphash.h"
+
+// Content types understood by the monitor. Clients pick one with the
+// `Accept` header; anything else falls back to JSON.
+#define WIRE_MIME_JSON "application/json"
+#define WIRE_MIME_MSGPACK "application/msgpack"
+#define WIRE_MIME_BINARY "application/vnd.battery-monitor.v1"
+
+#define WIRE_MAGIC 0xB7
+#define WIRE_VERSION 1
+#define WIRE_DEVICE_ID_SIZE 20  // Same as DEVICE_ID_SIZE in the monitor's EEPROM layout
+
+// Both the ESP32 monitor and the ESP8266 relay nodes are little-endian, so
+// the frames below are sent as-is without any byte swapping.
+enum WireFrameType : uint8_t {
+  WIRE_FRAME_STATUS = 1,
+  WIRE_FRAME_DEVICE_TELEMETRY = 2,
+  WIRE_FRAME_MONITOR_TELEMETRY = 3,
+  WIRE_FRAME_ACK = 4,
+  WIRE_FRAME_RADIO_TELEMETRY = 5,
+  WIRE_FRAME_RADIO_THRESHOLDS = 6,
+  WIRE_FRAME_RADIO_RELAY_STATE = 7,
+  WIRE_FRAME_BEACON = 8,
+};
+
+// UDP multicast group and port of the monitor's beacon.
+#define WIRE_BEACON_GROUP 239, 255, 66, 1
+#define WIRE_BEACON_PORT 4210
+
+#define WIRE_FNV_OFFSET 2166136261u
+
+// Radio frames end in a SipHash-2-4 tag over everything before it, under a key shared by the monitor
+// and its relay nodes. Override the default with -DWIRE_RADIO_KEY={...} in both platformio.ini files;
+// anyone with the firmware source knows this one.
+#ifndef WIRE_RADIO_KEY
+#define WIRE_RADIO_KEY {0x62, 0x61, 0x74, 0x74, 0x65, 0x72, 0x79, 0x2d, 0x6d, 0x6f, 0x6e, 0x69, 0x74, 0x6f, 0x72, 0x31}
+#endif
+#define WIRE_TAG_SIZE 8
+#define WIRE_RADIO_THRESHOLDS_MAX 8  // Keeps the frame under ESP-NOW's 250 bytes
+
+struct __attribute__((packed)) WireHeader {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t type;    // WireFrameType
+  uint8_t length;  // Size of the whole frame, header included
+};
+
+// Reply to any request that only carries a status, e.g. the POST endpoints.
+struct __attribute__((packed)) WireStatusFrame {
+  WireHeader header;
+  uint16_t httpStatus;
+};
+
+// Reply to a command that was queued for the monitor's main loop. `seq` can be
+// looked up with `/commandStatus` once the command has been applied.
+struct __attribute__((packed)) WireAckFrame {
+  WireHeader header;
+  uint16_t httpStatus;
+  uint32_t seq;
+};
+
+// Binary form of `/getVoltageById`.
+struct __attribute__((packed)) WireDeviceTelemetryFrame {
+  WireHeader header;
+  char deviceId[WIRE_DEVICE_ID_SIZE];  // Not null terminated when all 20 bytes are used
+  int16_t threshold;                   // Switch-off percentage stored for the device
+  uint8_t systemType;                  // 12, 24 or 48 (0 if unknown)
+  uint16_t percentageCenti;            // Battery percentage * 100
+};
+
+// Binary form of `/getvoltage`.
+struct __attribute__((packed)) WireMonitorTelemetryFrame {
+  WireHeader header;
+  uint16_t voltageCenti;  // Battery voltage * 100
+  uint16_t percentageCenti;
+  uint8_t systemType;
+  uint8_t setPercentageForOff;
+};
+
+// Broadcast by the monitor whenever the percentage or a threshold changes, and as a heartbeat. `epoch`
+// counts the monitor's boots and `seq` counts up within one, so a receiver can drop replayed frames
+// (see WireReplayWindow).
+struct __attribute__((packed)) WireRadioTelemetryFrame {
+  WireHeader header;
+  uint32_t epoch;
+  uint32_t seq;
+  uint32_t generation;       // Bumped whenever a threshold may have changed, as `gen` on /events
+  uint16_t percentageCenti;  // Battery percentage * 100
+  uint8_t systemType;
+  uint8_t tag[WIRE_TAG_SIZE];
+};
+
+struct __attribute__((packed)) WireRadioThreshold {
+  char deviceId[WIRE_DEVICE_ID_SIZE];  // Not null terminated when all 20 bytes are used
+  uint8_t threshold;
+};
+
+// Thresholds of all devices as of `generation`, in pages of up to WIRE_RADIO_THRESHOLDS_MAX entries.
+struct __attribute__((packed)) WireRadioThresholdsFrame {
+  WireHeader header;
+  uint32_t epoch;
+  uint32_t seq;
+  uint32_t generation;
+  uint8_t defaultThreshold;  // For devices without an entry, the monitor's own switch-off percentage
+  uint8_t first;  // Index of entries[0] among all devices
+  uint8_t total;  // Devices in all pages together
+  uint8_t count;  // Entries used in this page
+  WireRadioThreshold entries[WIRE_RADIO_THRESHOLDS_MAX];
+  uint8_t tag[WIRE_TAG_SIZE];
+};
+
+// Sent by a relay node to the monitor after it acted on a telemetry frame.
+struct __attribute__((packed)) WireRadioRelayStateFrame {
+  WireHeader header;
+  uint32_t epoch;  // Both copied from the telemetry frame being acknowledged
+  uint32_t seq;
+  uint8_t channels;
+  uint8_t loadOnMask;  // Bit n set when channel n's load is on
+  uint16_t switches;   // All channels together since the node booted
+  uint8_t tag[WIRE_TAG_SIZE];
+};
+
+// Multicast on the monitor's network on every change and as a keepalive, so any number of relay nodes
+// can follow the battery without a request each. `tableHash` changes whenever a threshold does; a node
+// only asks for its thresholds over HTTP then. Signed and sequenced like the radio frames.
+struct __attribute__((packed)) WireBeaconFrame {
+  WireHeader header;
+  uint32_t epoch;
+  uint32_t seq;
+  uint32_t tableHash;        // wireFnv1a over the device IDs, their thresholds and the default one
+  uint16_t percentageCenti;  // Battery percentage * 100
+  uint8_t systemType;
+  uint8_t tag[WIRE_TAG_SIZE];
+};
+
+/**
+ * Fills in the common header of a frame.
+ *
+ * @param header Header at the start of the frame being built.
+ * @param type The `WireFrameType` of the frame.
+ * @param length `sizeof` the whole frame.
+ */
+inline void wireInitHeader(WireHeader &header, uint8_t type, uint8_t length) {
+  header.magic = WIRE_MAGIC;
+  header.version = WIRE_VERSION;
+  header.type = type;
+  header.length = length;
+}
+
+/**
+ * Checks that a received buffer holds a complete frame of the expected type
+ * and copies it out, so callers never read a packed struct in place.
+ *
+ * @return true if `frame` now holds a valid frame, false otherwise.
+ */
+inline bool wireDecode(const uint8_t *data, size_t len, uint8_t type, void *frame, size_t frameSize) {
+  if (len < frameSize || frameSize < sizeof(WireHeader)) {
+    return false;
+  }
+  WireHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != WIRE_MAGIC || header.version != WIRE_VERSION || header.type != type ||
+      header.length != frameSize) {
+    return false;
+  }
+  memcpy(frame, data, frameSize);
+  return true;
+}
+
+// FNV-1a over `length` more bytes; start with `WIRE_FNV_OFFSET`.
+inline uint32_t wireFnv1a(uint32_t hash, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Writes the tag into the last `WIRE_TAG_SIZE` bytes of a radio frame.
+ *
+ * @param frameSize `sizeof` the whole frame, tag included.
+ */
+inline void wireSign(void *frame, size_t frameSize, const uint8_t key[SIPHASH_KEY_SIZE]) {
+  uint64_t tag = siphash24(key, frame, frameSize - WIRE_TAG_SIZE);
+  memcpy((uint8_t *)frame + frameSize - WIRE_TAG_SIZE, &tag, WIRE_TAG_SIZE);
+}
+
+// Checks the tag of a radio frame decoded with `wireDecode`.
+inline bool wireVerify(const void *frame, size_t frameSize, const uint8_t key[SIPHASH_KEY_SIZE]) {
+  uint64_t expected = siphash24(key, frame, frameSize - WIRE_TAG_SIZE);
+  uint64_t tag;
+  memcpy(&tag, (const uint8_t *)frame + frameSize - WIRE_TAG_SIZE, WIRE_TAG_SIZE);
+  return tag == expected;
+}
+
+/**
+ * Replay check for signed frames on one transport. `epoch` is the monitor's boot counter, which only
+ * ever goes up, and `seq` counts up within a boot: a frame is taken only if it is from a later boot, or
+ * from the same boot and newer than the last one taken. Once a boot has been seen, frames recorded in an
+ * earlier one are refused for good; only a receiver that restarted and has not heard the monitor since
+ * can be handed one, and the first live frame ends that. The tag keeps anyone without the key from
+ * making new frames. Each transport numbers its frames separately, so each needs its own window.
+ */
+struct WireReplayWindow {
+  uint32_t epoch;
+  uint32_t seq;
+
+  bool accept(uint32_t frameEpoch, uint32_t frameSeq) {
+    if (frameEpoch < epoch || (frameEpoch == epoch && (int32_t)(frameSeq - seq) <= 0)) {
+      return false;
+    }
+    epoch = frameEpoch;
+    seq = frameSeq;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRANSPORT_ADDRESS_SIZE 6  // A MAC address for ESP-NOW
+
+// Called for every frame received. May run in the radio driver's context: copy the data and return.
+typedef void (*TransportReceiver)(void *context, const uint8_t *from, const uint8_t *data, size_t len);
+
+/**
+ * Connectionless datagram link between the monitor and the relay nodes. Frames are small, may be lost
+ * and carry no guarantee of order; anything that needs more builds it on top, as the signed radio
+ * frames in telemetry_wire.h do.
+ */
+class Transport {
+ public:
+  Transport() : receiver(NULL), context(NULL) {}
+  virtual ~Transport() {}
+
+  virtual bool begin() = 0;
+
+  /**
+   * Sends one frame.
+   *
+   * @param to Address of the receiver, or NULL to broadcast.
+   * @return true if the frame was handed to the link, which does not mean it arrived.
+   */
+  virtual bool send(const uint8_t *to, const uint8_t *data, size_t len) = 0;
+
+  // Largest frame `send` accepts.
+  virtual size_t maxFrameSize() const = 0;
+
+  void onReceive(TransportReceiver receiver, void *context) {
+    this->receiver = receiver;
+    this->context = context;
+  }
+
+ protected:
+  void deliver(const uint8_t *from, const uint8_t *data, size_t len) {
+    if (receiver != NULL) {
+      receiver(context, from, data, len);
+    }
+  }
+
+ private:
+  TransportReceiver receiver;
+  void *context;
+};
+
+#endif
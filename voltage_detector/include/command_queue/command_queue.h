@@ -0,0 +1,197 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <telemetry_wire.h>
+
+/**
+ * Bounded lock-free queue with any number of producers and a single consumer (Vyukov's bounded
+ * queue). Each cell carries a sequence number telling producers and the consumer whose turn it is,
+ * so `push` and `pop` never block and never allocate.
+ *
+ * `push` may be called from any task; `pop` only from the task that owns the queue.
+ */
+template <typename T, size_t N>
+class MpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+
+ public:
+  MpscQueue() : enqueuePos(0), dequeuePos(0) {
+    for (size_t i = 0; i < N; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Copies `item` into the queue.
+   *
+   * @return false if the queue is full, in which case nothing was queued.
+   */
+  bool push(const T &item) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells[pos & (N - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // The consumer has not freed this cell yet
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Copies `count` items into consecutive cells, all of them or none, so a batch is never left half
+   * queued.
+   *
+   * @return false if there is no room for all of them, in which case nothing was queued.
+   */
+  bool pushAll(const T *items, size_t count) {
+    if (count == 0) {
+      return true;
+    }
+    if (count > N) {
+      return false;
+    }
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      // The consumer frees cells in order, so the batch fits if its last cell is free.
+      size_t first = cells[pos & (N - 1)].sequence.load(std::memory_order_acquire);
+      size_t last = cells[(pos + count - 1) & (N - 1)].sequence.load(std::memory_order_acquire);
+      intptr_t firstDiff = (intptr_t)first - (intptr_t)pos;
+      intptr_t lastDiff = (intptr_t)last - (intptr_t)(pos + count - 1);
+      if (firstDiff == 0 && lastDiff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (firstDiff < 0 || lastDiff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      Cell &cell = cells[(pos + i) & (N - 1)];
+      cell.data = items[i];
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  /**
+   * Moves the oldest item into `item`.
+   *
+   * @return false if there was nothing to pop.
+   */
+  bool pop(T &item) {
+    Cell *cell = &cells[dequeuePos & (N - 1)];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(dequeuePos + 1) < 0) {
+      return false;
+    }
+    item = cell->data;
+    cell->sequence.store(dequeuePos + N, std::memory_order_release);
+    dequeuePos++;
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  Cell cells[N];
+  std::atomic<size_t> enqueuePos;
+  size_t dequeuePos;  // Only touched by the consumer
+};
+
+enum CommandType : uint8_t {
+  COMMAND_SET_DEFAULT_OFF,
+  COMMAND_SET_DEVICE_PERCENTAGE,
+  COMMAND_DELETE_DEVICE,
+  COMMAND_BUTTON_EVENT,  // `value` is `button << 8 | ButtonEvent`, `seq` is 0
+  COMMAND_SET_LOW_POWER,
+};
+
+enum CommandResult : uint8_t {
+  COMMAND_PENDING,
+  COMMAND_APPLIED,
+  COMMAND_NOT_FOUND,
+  COMMAND_EXPIRED,  // Too old, its slot has been reused
+};
+
+// A state change requested by an HTTP handler or the buttons and applied by the service task.
+struct Command {
+  uint32_t seq;
+  CommandType type;
+  int value;
+  char deviceId[WIRE_DEVICE_ID_SIZE + 1];
+};
+
+#define COMMAND_ACK_SLOTS 16
+
+/**
+ * Results of recently applied commands, so clients can poll for the outcome of a request that was
+ * answered with 202 before the service task got to it. Each slot packs `seq << 2 | result` into one word,
+ * which keeps a reader from ever seeing the result of one command paired with the seq of another.
+ */
+class CommandAcks {
+ public:
+  CommandAcks() : issued(0) {
+    for (size_t i = 0; i < COMMAND_ACK_SLOTS; i++) {
+      slots[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Hands out the next sequence number, starting at 1.
+  uint32_t next() {
+    return issued.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // Called by the consumer once the command with this `seq` has been applied.
+  void complete(uint32_t seq, CommandResult result) {
+    slots[seq % COMMAND_ACK_SLOTS].store(seq << 2 | result, std::memory_order_release);
+  }
+
+  /**
+   * Looks up the outcome of a command.
+   *
+   * @return `COMMAND_PENDING` while it is still queued, `COMMAND_EXPIRED` once too many newer commands
+   * have completed to remember it. Unknown sequence numbers are reported as expired too; callers can
+   * tell them apart with `isIssued`.
+   */
+  CommandResult lookup(uint32_t seq) const {
+    uint32_t packed = slots[seq % COMMAND_ACK_SLOTS].load(std::memory_order_acquire);
+    uint32_t slotSeq = packed >> 2;
+
+    if (slotSeq == seq) {
+      return (CommandResult)(packed & 3);
+    }
+    if (slotSeq < seq && isIssued(seq)) {
+      return COMMAND_PENDING;
+    }
+    return COMMAND_EXPIRED;
+  }
+
+  bool isIssued(uint32_t seq) const {
+    return seq != 0 && seq <= issued.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint32_t> issued;
+  std::atomic<uint32_t> slots[COMMAND_ACK_SLOTS];
+};
+
+#endif
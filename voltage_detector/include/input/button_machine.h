@@ -0,0 +1,108 @@
+#ifndef BUTTON_MACHINE_H
+#define BUTTON_MACHINE_H
+
+#include <stdint.h>
+
+enum ButtonEvent : uint8_t {
+  BUTTON_EVENT_NONE,
+  BUTTON_EVENT_PRESS,
+  BUTTON_EVENT_LONG_PRESS,  // Held for `longPressMs`
+  BUTTON_EVENT_REPEAT,      // Every `repeatMs` after a long press while still held
+  BUTTON_EVENT_RELEASE,
+};
+
+// Timing of one button. A zero `longPressMs` disables long presses, a zero `repeatMs` disables
+// auto-repeat.
+struct ButtonTiming {
+  uint32_t debounceMs;
+  uint32_t longPressMs;
+  uint32_t repeatMs;
+};
+
+/**
+ * Press, long-press and auto-repeat detection for one button. The machine has no notion of time of
+ * its own: the caller feeds it the button level whenever the level has been stable for `debounceMs`,
+ * and again once `deadlineMs()` has passed, so on target it is driven by a one-shot timer that edge
+ * interrupts push back by `debounceMs`. Nothing runs while no button is held.
+ *
+ * Not thread-safe; each machine must only be updated from one task.
+ */
+class ButtonMachine {
+ public:
+  explicit ButtonMachine(ButtonTiming timing) : timing(timing), state(IDLE), deadline(0) {}
+
+  /**
+   * Advances the machine.
+   *
+   * @param pressed The debounced button level.
+   *
+   * @return The event produced by this step, `BUTTON_EVENT_NONE` if there is none.
+   */
+  ButtonEvent update(bool pressed, uint32_t nowMs) {
+    if (!pressed) {
+      if (state == IDLE) {
+        return BUTTON_EVENT_NONE;
+      }
+      state = IDLE;
+      return BUTTON_EVENT_RELEASE;
+    }
+
+    switch (state) {
+      case IDLE:
+        state = HELD;
+        deadline = nowMs + timing.longPressMs;
+        return BUTTON_EVENT_PRESS;
+      case HELD:
+        if (timing.longPressMs == 0 || !due(nowMs)) {
+          return BUTTON_EVENT_NONE;
+        }
+        state = timing.repeatMs == 0 ? LATCHED : REPEATING;
+        deadline = nowMs + timing.repeatMs;
+        return BUTTON_EVENT_LONG_PRESS;
+      case REPEATING:
+        if (!due(nowMs)) {
+          return BUTTON_EVENT_NONE;
+        }
+        // Keep a steady rate, but do not fire a burst if the caller woke up late.
+        deadline += timing.repeatMs;
+        if ((int32_t)(deadline - nowMs) <= 0) {
+          deadline = nowMs + timing.repeatMs;
+        }
+        return BUTTON_EVENT_REPEAT;
+      case LATCHED:
+        break;
+    }
+    return BUTTON_EVENT_NONE;
+  }
+
+  // Whether the machine needs another `update` at `deadlineMs()` even if the level does not change.
+  bool waiting() const {
+    return (state == HELD && timing.longPressMs != 0) || state == REPEATING;
+  }
+
+  uint32_t deadlineMs() const {
+    return deadline;
+  }
+
+  const ButtonTiming &buttonTiming() const {
+    return timing;
+  }
+
+ private:
+  enum State : uint8_t {
+    IDLE,
+    HELD,       // Pressed, waiting for the long press
+    REPEATING,  // Long press seen, auto-repeating
+    LATCHED,    // Long press seen, no repeat configured; waiting for the release
+  };
+
+  bool due(uint32_t nowMs) const {
+    return (int32_t)(nowMs - deadline) >= 0;
+  }
+
+  ButtonTiming timing;
+  State state;
+  uint32_t deadline;
+};
+
+#endif
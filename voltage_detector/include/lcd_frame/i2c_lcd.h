@@ -0,0 +1,83 @@
+#ifndef I2C_LCD_H
+#define I2C_LCD_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <command_queue/command_queue.h>
+#include <lcd_frame/lcd_frame.h>
+
+#define I2C_LCD_QUEUE_SIZE 128  // Entries, enough for three full redraws
+#define I2C_LCD_BATCH 16        // LCD bytes per I2C transaction; each takes 4 bytes of the 128 byte Wire buffer
+
+// Counters of the display's I2C traffic since boot.
+struct I2cLcdStats {
+  uint32_t busHz;
+  uint32_t transactions;
+  uint32_t bytes;        // Bytes delivered to the LCD controller
+  uint32_t nackAddress;  // Nobody answered at the backpack's address
+  uint32_t nackData;
+  uint32_t timeouts;
+  uint32_t otherErrors;
+  uint32_t overflows;    // Writes dropped because the queue was full
+};
+
+/**
+ * HD44780 display behind a PCF8574 I2C backpack, driven in 4-bit mode. `setCursor` and `write` only
+ * queue the bytes; a background task sends them, so callers never wait on the bus.
+ *
+ * Any task may call the `LcdSink` methods and `setBacklight`, but only one at a time. After `begin`
+ * the background task is the only user of `Wire`.
+ */
+class I2cLcd : public LcdSink {
+ public:
+  explicit I2cLcd(uint8_t address);
+
+  /**
+   * Initializes the controller, synchronously, and starts the background task.
+   *
+   * @param busHz I2C clock. The PCF8574 is only specified up to 100 kHz, though most backpacks cope
+   * with 400 kHz.
+   */
+  void begin(uint32_t busHz, BaseType_t core, UBaseType_t priority);
+
+  void setCursor(uint8_t col, uint8_t row) override;
+  void write(const char *text, size_t len) override;
+  void setBacklight(bool on);
+
+  /**
+   * Tells whether writes were dropped or failed on the bus since the last call, in which case the
+   * display no longer shows what the renderer thinks it does and should be invalidated.
+   */
+  bool takeOverflow();
+
+  I2cLcdStats stats() const;
+
+  // Whether everything queued has been sent, so the bus is quiet.
+  bool idle() const {
+    return pending.load(std::memory_order_acquire) == 0;
+  }
+
+ private:
+  static void drainTask(void *arg);
+  void enqueue(uint16_t entry);
+  void notify();
+  void transmit(const uint16_t *entries, size_t count);
+  void sendNibble(uint8_t nibble);
+
+  uint8_t address;
+  uint8_t backlightBit;  // Only touched by the background task after `begin`
+  uint32_t busHz;
+  TaskHandle_t task;
+  MpscQueue<uint16_t, I2C_LCD_QUEUE_SIZE> queue;
+  std::atomic<uint32_t> pending;  // Entries queued or being sent
+  std::atomic<bool> overflowed;
+  std::atomic<uint32_t> transactions;
+  std::atomic<uint32_t> bytes;
+  std::atomic<uint32_t> nackAddress;
+  std::atomic<uint32_t> nackData;
+  std::atomic<uint32_t> timeouts;
+  std::atomic<uint32_t> otherErrors;
+  std::atomic<uint32_t> overflows;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef LCD_FRAME_H
+#define LCD_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+// Where `LcdRenderer` sends its output: the real display on the device, or a recorder in tests.
+class LcdSink {
+ public:
+  virtual ~LcdSink() {}
+  virtual void setCursor(uint8_t col, uint8_t row) = 0;
+  virtual void write(const char *text, size_t len) = 0;
+};
+
+// What the 16x2 display should show. Screens are drawn here first, then handed to `LcdRenderer`.
+class LcdFrame {
+ public:
+  LcdFrame();
+
+  // Fills the frame with spaces.
+  void clear();
+
+  // Writes `text` starting at (col, row). Anything past the end of the row is dropped.
+  void print(uint8_t col, uint8_t row, const char *text);
+
+  // printf-style `print`, formatted into a row-sized buffer.
+  void printf(uint8_t col, uint8_t row, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+  bool operator==(const LcdFrame &other) const;
+
+  char cells[LCD_ROWS][LCD_COLS];
+};
+
+/**
+ * Keeps a copy of what is on the display and only sends the cells that changed since the last frame,
+ * without ever clearing the screen. Runs of changes separated by a single unchanged cell are merged,
+ * since rewriting that cell costs the same as moving the cursor past it.
+ */
+class LcdRenderer {
+ public:
+  explicit LcdRenderer(LcdSink &sink);
+
+  // Forgets what is on the display, so the next `render` redraws everything.
+  void invalidate();
+
+  /**
+   * Brings the display in line with `frame`.
+   *
+   * @return The number of bytes sent to the LCD controller (cursor commands plus characters). Each one
+   * is four bytes on the I2C bus through the PCF8574 backpack, see `I2cLcd`.
+   */
+  size_t render(const LcdFrame &frame);
+
+  uint32_t bytesSent() const {
+    return totalBytes;
+  }
+
+ private:
+  LcdSink &sink;
+  LcdFrame shown;
+  bool valid;
+  uint32_t totalBytes;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef NODE_STATUS_H
+#define NODE_STATUS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define NODE_STATUS_SIZE 16
+#define NODE_ID_SIZE 32  // Longer device IDs are cut
+
+/**
+ * What a relay node said about itself in the query of its last poll. A node has no other way out: on
+ * an ESP-01 the UART's TX pin drives a relay coil, so nothing it prints is ever read.
+ */
+struct NodeStatus {
+  char nodeId[NODE_ID_SIZE];  // The first device ID of its poll
+  uint32_t polls;
+  uint32_t lastPollMs;
+  // Duty-cycled nodes only, for the cycle before the poll; 0 otherwise
+  uint32_t awakeMs;
+  uint32_t averageUa;  // Estimated average current over the cycle
+  // Counters since the node booted
+  uint32_t connects;       // Poll connections opened
+  uint32_t reuses;         // Polls on a kept-alive connection
+  uint32_t parseHeap;      // Heap taken by parsing its previous reply
+  uint32_t beacons;
+  uint32_t radioFrames;    // ESP-NOW frames accepted
+  uint32_t radioRejected;  // Radio frames and beacons refused
+};
+
+/**
+ * The relay nodes that polled, by node ID. When the table is full the node that has gone longest
+ * without a poll makes room.
+ *
+ * Not thread-safe; only touched from the async TCP task, where all HTTP handlers run.
+ */
+class NodeStatusTable {
+ public:
+  NodeStatusTable() : count(0), entries() {}
+
+  /**
+   * Counts a poll by node `nodeId` at `nowMs`.
+   *
+   * @return Its entry, for the caller to fill in what the poll reported.
+   */
+  NodeStatus &record(const char *nodeId, uint32_t nowMs) {
+    int i = find(nodeId);
+    if (i < 0) {
+      i = count < NODE_STATUS_SIZE ? count++ : stalest(nowMs);
+      entries[i] = NodeStatus{};
+      strncpy(entries[i].nodeId, nodeId, NODE_ID_SIZE - 1);
+    }
+    entries[i].polls++;
+    entries[i].lastPollMs = nowMs;
+    return entries[i];
+  }
+
+  const NodeStatus &entry(uint32_t i) const {
+    return entries[i];
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+ private:
+  int find(const char *nodeId) const {
+    for (uint32_t i = 0; i < count; i++) {
+      if (strncmp(entries[i].nodeId, nodeId, NODE_ID_SIZE - 1) == 0) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  int stalest(uint32_t nowMs) const {
+    int stalest = 0;
+    for (uint32_t i = 1; i < count; i++) {
+      if (nowMs - entries[i].lastPollMs > nowMs - entries[stalest].lastPollMs) {
+        stalest = i;
+      }
+    }
+    return stalest;
+  }
+
+  uint32_t count;
+  NodeStatus entries[NODE_STATUS_SIZE];
+};
+
+#endif
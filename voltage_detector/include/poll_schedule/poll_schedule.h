@@ -0,0 +1,96 @@
+#ifndef POLL_SCHEDULE_H
+#define POLL_SCHEDULE_H
+
+#include <stdint.h>
+
+#define ARRIVAL_GAP_BUCKETS 16    // Powers of two from 1 ms up to 32 s and more
+#define ARRIVAL_PHASE_BUCKETS 12  // Slices of the phase window
+#define ARRIVAL_PHASE_WINDOW_MS 60000
+
+struct PollScheduleConfig {
+  uint32_t minIntervalMs;  // Interval at or inside `nearPercent` of the threshold
+  uint32_t maxIntervalMs;  // Interval at or beyond `farPercent`
+  float nearPercent;
+  float farPercent;
+};
+
+/**
+ * How often a relay node should poll, from how far the charge is from its device's threshold: the
+ * interval runs linearly from `minIntervalMs` close to the threshold to `maxIntervalMs` far away, so
+ * nodes whose relay may switch soon look more often.
+ */
+inline uint32_t pollIntervalMs(const PollScheduleConfig &config, float percentage, float threshold) {
+  float distance = percentage > threshold ? percentage - threshold : threshold - percentage;
+  if (distance <= config.nearPercent) {
+    return config.minIntervalMs;
+  }
+  if (distance >= config.farPercent) {
+    return config.maxIntervalMs;
+  }
+  float share = (distance - config.nearPercent) / (config.farPercent - config.nearPercent);
+  return config.minIntervalMs + (uint32_t)(share * (config.maxIntervalMs - config.minIntervalMs));
+}
+
+/**
+ * Offset of slot `slot` of `slotCount` within an interval. Spreading devices over the slots keeps nodes
+ * that came up together from polling together.
+ */
+inline uint32_t pollSlotMs(uint32_t slot, uint32_t slotCount, uint32_t intervalMs) {
+  return (uint32_t)((uint64_t)(slot % slotCount) * intervalMs / slotCount);
+}
+
+/**
+ * Time from `nowMs` to the next start of the slot, on the monitor's clock. A node that polled right on
+ * its slot is sent to the next one, a whole interval away, rather than straight back.
+ */
+inline uint32_t pollDelayMs(uint32_t slotMs, uint32_t intervalMs, uint32_t nowMs) {
+  uint32_t delayMs = (slotMs % intervalMs + intervalMs - nowMs % intervalMs) % intervalMs;
+  return delayMs == 0 ? intervalMs : delayMs;
+}
+
+/**
+ * When poll requests arrive. The gap histogram shows bursts, many requests within a few milliseconds
+ * of each other; the phase histogram shows whether they bunch up at one point of a minute.
+ *
+ * Not thread-safe; only touched from the async TCP task, where all HTTP handlers run.
+ */
+class ArrivalHistogram {
+ public:
+  ArrivalHistogram() : requests(0), lastMs(0), gaps(), phases() {}
+
+  void record(uint32_t nowMs) {
+    if (requests > 0) {
+      uint32_t gap = nowMs - lastMs;
+      uint32_t bucket = 0;
+      while (gap > 1 && bucket < ARRIVAL_GAP_BUCKETS - 1) {
+        gap >>= 1;
+        bucket++;
+      }
+      gaps[bucket]++;
+    }
+    phases[(nowMs % ARRIVAL_PHASE_WINDOW_MS) * ARRIVAL_PHASE_BUCKETS / ARRIVAL_PHASE_WINDOW_MS]++;
+    requests++;
+    lastMs = nowMs;
+  }
+
+  uint32_t count() const {
+    return requests;
+  }
+
+  // Requests that came less than 2^(i+1) ms after the previous one, and at least 2^i ms for i > 0.
+  uint32_t gapCount(uint32_t i) const {
+    return gaps[i];
+  }
+
+  uint32_t phaseCount(uint32_t i) const {
+    return phases[i];
+  }
+
+ private:
+  uint32_t requests;
+  uint32_t lastMs;
+  uint32_t gaps[ARRIVAL_GAP_BUCKETS];
+  uint32_t phases[ARRIVAL_PHASE_BUCKETS];
+};
+
+#endif
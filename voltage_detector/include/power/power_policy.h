@@ -0,0 +1,110 @@
+#ifndef POWER_POLICY_H
+#define POWER_POLICY_H
+
+#include <stdint.h>
+
+struct PowerPolicyConfig {
+  uint32_t backlightTimeoutMs;  // Backlight goes off this long after the last button press
+  uint32_t boostHoldMs;         // Full CPU speed for this long after any button press or request
+  uint32_t sleepAfterMs;        // No light sleep until the monitor has been left alone this long
+  uint32_t minSleepMs;          // Not worth entering light sleep for less
+  uint32_t maxSleepMs;          // Longest single light sleep, so the access point stays discoverable
+  uint32_t minAwakeMs;          // Time awake between two light sleeps, for beacons and probe replies
+};
+
+/**
+ * Decides the monitor's power state from how long ago someone last touched it. It only makes the
+ * decisions; the caller switches the clock, backlight and sleep.
+ *
+ * Times are `millis()` values. Not thread-safe; owned by the service task.
+ */
+class PowerPolicy {
+ public:
+  explicit PowerPolicy(PowerPolicyConfig config) : config(config), lastInputMs(0), lastWakeMs(0) {}
+
+  // A button was pressed. Requests only count through the `lastRequestMs` arguments below.
+  void input(uint32_t nowMs) {
+    lastInputMs = nowMs;
+  }
+
+  bool backlightOn(uint32_t nowMs) const {
+    return nowMs - lastInputMs < config.backlightTimeoutMs;
+  }
+
+  bool boost(uint32_t nowMs, uint32_t lastRequestMs) const {
+    return nowMs - lastInputMs < config.boostHoldMs || nowMs - lastRequestMs < config.boostHoldMs;
+  }
+
+  /**
+   * Tells how long the monitor may light sleep now.
+   *
+   * @param stations Number of stations associated with the access point. The ESP32 cannot keep an
+   * association alive through light sleep in AP mode, so any station keeps the monitor awake.
+   * @param idleMs Time until the next scheduled work, sampling included.
+   *
+   * @return The sleep time in milliseconds, 0 to stay awake.
+   */
+  uint32_t sleepBudget(uint32_t nowMs, uint32_t lastRequestMs, uint32_t stations, uint32_t idleMs) const {
+    if (stations > 0 || idleMs < config.minSleepMs || nowMs - lastWakeMs < config.minAwakeMs) {
+      return 0;
+    }
+    if (nowMs - lastInputMs < config.sleepAfterMs || nowMs - lastRequestMs < config.sleepAfterMs) {
+      return 0;
+    }
+    return idleMs < config.maxSleepMs ? idleMs : config.maxSleepMs;
+  }
+
+  // Called after waking from light sleep.
+  void woke(uint32_t nowMs) {
+    lastWakeMs = nowMs;
+  }
+
+ private:
+  PowerPolicyConfig config;
+  uint32_t lastInputMs;
+  uint32_t lastWakeMs;
+};
+
+// Estimated supply current in each state, in milliamps. Rough figures from the ESP32 datasheet for a
+// running soft AP and from typical 1602 modules; measure the actual board to tighten them.
+struct PowerProfile {
+  float fastMa;       // 240 MHz
+  float slowMa;       // 80 MHz
+  float sleepMa;      // Light sleep
+  float backlightMa;  // Added while the backlight is on
+};
+
+// Time spent in each power state since boot, for /power.
+struct PowerReport {
+  uint64_t fastUs;
+  uint64_t slowUs;
+  uint64_t sleepUs;
+  uint64_t backlightUs;
+  uint32_t sleeps;
+  uint32_t cpuMhz;
+  bool backlight;
+  bool lowPower;
+};
+
+/**
+ * The share of time the monitor was awake.
+ */
+inline float powerDutyCycle(const PowerReport &report) {
+  uint64_t total = report.fastUs + report.slowUs + report.sleepUs;
+  return total == 0 ? 1.0f : (float)(report.fastUs + report.slowUs) / total;
+}
+
+/**
+ * The average supply current since boot, from the time spent in each state.
+ */
+inline float powerAverageMa(const PowerReport &report, const PowerProfile &profile) {
+  uint64_t total = report.fastUs + report.slowUs + report.sleepUs;
+  if (total == 0) {
+    return 0;
+  }
+  double charge = (double)report.fastUs * profile.fastMa + (double)report.slowUs * profile.slowMa +
+                  (double)report.sleepUs * profile.sleepMa + (double)report.backlightUs * profile.backlightMa;
+  return (float)(charge / total);
+}
+
+#endif
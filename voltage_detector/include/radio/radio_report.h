@@ -0,0 +1,44 @@
+#ifndef RADIO_REPORT_H
+#define RADIO_REPORT_H
+
+#include <stdint.h>
+#include <transport.h>
+
+#define RADIO_MAX_NODES 8
+
+// A relay node's acknowledgement as taken off the radio, queued for the service task.
+struct RadioAck {
+  uint8_t address[TRANSPORT_ADDRESS_SIZE];
+  uint32_t seq;
+  uint8_t channels;
+  uint8_t loadOnMask;
+  uint16_t switches;
+  int64_t receivedUs;  // esp_timer time
+};
+
+// Last acknowledgement of one relay node.
+struct RadioNode {
+  uint8_t address[TRANSPORT_ADDRESS_SIZE];
+  uint32_t acks;
+  uint32_t lastSeq;
+  uint32_t lastAckMs;         // `millis()` when it arrived
+  uint32_t roundTripUs;       // From broadcasting the telemetry frame to its ack, 0 if not matched
+  uint32_t maxRoundTripUs;
+  uint8_t channels;
+  uint8_t loadOnMask;
+  uint16_t switches;
+};
+
+// What the ESP-NOW link has done since boot, see /radio.
+struct RadioReport {
+  uint32_t framesSent;
+  uint32_t sendFailures;
+  uint32_t acksReceived;
+  uint32_t badFrames;     // Frames that did not decode, failed the tag or carried another epoch
+  uint32_t acksDropped;   // Arrived while the ack queue was full
+  uint32_t acksReplayed;  // Named a telemetry frame not recently sent, or one the node already acknowledged
+  uint32_t count;
+  RadioNode nodes[RADIO_MAX_NODES];  // In order of first contact; later nodes are not tracked
+};
+
+#endif
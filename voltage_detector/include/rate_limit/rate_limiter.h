@@ -0,0 +1,120 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RATE_LIMIT_MAX_CLIENTS 24
+
+enum RateClass {
+  RATE_READ,
+  RATE_WRITE,
+  RATE_CLASS_COUNT,
+};
+
+// Sustained rate and burst allowed for one class of requests.
+struct RateBudget {
+  uint32_t perMinute;
+  uint32_t burst;
+};
+
+struct RateLimitClient {
+  uint32_t ip;
+  uint32_t lastSeenMs;
+  uint64_t credit[RATE_CLASS_COUNT];  // Token bucket level, in 1/60000ths of a request
+  uint32_t refilledAtMs[RATE_CLASS_COUNT];
+  uint32_t allowed[RATE_CLASS_COUNT];
+  uint32_t limited[RATE_CLASS_COUNT];
+};
+
+/**
+ * Per-client token buckets with separate read and write budgets. Clients are identified by IPv4
+ * address and kept in a small fixed table; when it is full the least recently seen client is dropped.
+ *
+ * Not thread-safe. All HTTP handlers run on the async TCP task, which is the only caller.
+ */
+class RateLimiter {
+ public:
+  RateLimiter(RateBudget read, RateBudget write) : clientCount(0) {
+    budgets[RATE_READ] = read;
+    budgets[RATE_WRITE] = write;
+  }
+
+  /**
+   * Takes one token from the client's bucket for `rateClass`.
+   *
+   * @param retryAfterMs Set to the time until the next token when the request is refused.
+   *
+   * @return true if the request may proceed.
+   */
+  bool allow(uint32_t ip, RateClass rateClass, uint32_t nowMs, uint32_t *retryAfterMs) {
+    RateLimitClient &client = lookup(ip, nowMs);
+    const RateBudget &budget = budgets[rateClass];
+
+    uint32_t elapsedMs = nowMs - client.refilledAtMs[rateClass];
+    uint64_t capacity = (uint64_t)budget.burst * TOKEN;
+    uint64_t credit = client.credit[rateClass] + (uint64_t)elapsedMs * budget.perMinute;
+    client.credit[rateClass] = credit > capacity ? capacity : credit;
+    client.refilledAtMs[rateClass] = nowMs;
+
+    if (client.credit[rateClass] >= TOKEN) {
+      client.credit[rateClass] -= TOKEN;
+      client.allowed[rateClass]++;
+      return true;
+    }
+
+    client.limited[rateClass]++;
+    if (retryAfterMs != NULL) {
+      uint64_t missing = TOKEN - client.credit[rateClass];
+      *retryAfterMs = budget.perMinute == 0 ? UINT32_MAX : (uint32_t)((missing + budget.perMinute - 1) / budget.perMinute);
+    }
+    return false;
+  }
+
+  size_t size() const {
+    return clientCount;
+  }
+
+  const RateLimitClient &client(size_t index) const {
+    return clients[index];
+  }
+
+  const RateBudget &budget(RateClass rateClass) const {
+    return budgets[rateClass];
+  }
+
+ private:
+  // One request's worth of credit: a bucket refilling at `perMinute` gains `perMinute` per ms.
+  static const uint64_t TOKEN = 60000;
+
+  RateLimitClient &lookup(uint32_t ip, uint32_t nowMs) {
+    size_t oldest = 0;
+    for (size_t i = 0; i < clientCount; i++) {
+      if (clients[i].ip == ip) {
+        clients[i].lastSeenMs = nowMs;
+        return clients[i];
+      }
+      if ((int32_t)(clients[i].lastSeenMs - clients[oldest].lastSeenMs) < 0) {
+        oldest = i;
+      }
+    }
+
+    size_t slot = clientCount < RATE_LIMIT_MAX_CLIENTS ? clientCount++ : oldest;
+    RateLimitClient &client = clients[slot];
+    client.ip = ip;
+    client.lastSeenMs = nowMs;
+    for (int c = 0; c < RATE_CLASS_COUNT; c++) {
+      client.credit[c] = (uint64_t)budgets[c].burst * TOKEN;  // New clients start with a full burst
+      client.refilledAtMs[c] = nowMs;
+      client.allowed[c] = 0;
+      client.limited[c] = 0;
+    }
+    return client;
+  }
+
+  RateBudget budgets[RATE_CLASS_COUNT];
+  RateLimitClient clients[RATE_LIMIT_MAX_CLIENTS];
+  size_t clientCount;
+};
+
+#endif
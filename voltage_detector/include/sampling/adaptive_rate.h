@@ -0,0 +1,98 @@
+#ifndef ADAPTIVE_RATE_H
+#define ADAPTIVE_RATE_H
+
+#include <math.h>
+#include <stdint.h>
+
+struct AdaptiveRateConfig {
+  uint32_t minPeriodMs;
+  uint32_t maxPeriodMs;
+  float noiseVolts;       // Changes this small between two samples are taken as ADC noise
+  float fastSlope;        // Volts per minute above which the battery counts as moving
+  float nearPercent;      // Distance to a threshold, in percentage points, that counts as close
+};
+
+// What the sampling task reports about its rate, see /sampling.
+struct SamplingReport {
+  uint32_t periodMs;
+  float slopePerMinute;
+  uint32_t rateChanges;
+  uint32_t samples;           // Samples taken since boot
+  uint32_t fixedRateSamples;  // Samples a fixed rate of `minPeriodMs` would have taken in the same time
+};
+
+/**
+ * Picks the time until the next sample from how fast the voltage is moving and how close the charge
+ * is to a switch-off threshold. While either calls for attention the period is halved on every
+ * sample, down to `minPeriodMs`; otherwise it grows by a quarter per sample up to `maxPeriodMs`, so a
+ * single noisy reading cannot swing the rate from one end to the other.
+ *
+ * Not thread-safe; owned by the sampling task.
+ */
+class AdaptiveRate {
+ public:
+  explicit AdaptiveRate(AdaptiveRateConfig config)
+      : config(config), period(config.minPeriodMs), slope(0), lastVolts(0), lastMs(0), primed(false), changes(0) {}
+
+  /**
+   * Takes a new sample into account.
+   *
+   * @param thresholdDistance Percentage points between the current charge and the nearest threshold,
+   * or a negative value when there is no threshold.
+   *
+   * @return The time until the next sample, in milliseconds.
+   */
+  uint32_t update(float volts, uint32_t nowMs, float thresholdDistance) {
+    if (primed && nowMs != lastMs) {
+      float change = fabsf(volts - lastVolts) - config.noiseVolts;
+      float instant = change > 0 ? change * 60000.0f / (nowMs - lastMs) : 0;
+      slope += (instant - slope) * SLOPE_SMOOTHING;
+    }
+    primed = true;
+    lastVolts = volts;
+    lastMs = nowMs;
+
+    bool near = thresholdDistance >= 0 && thresholdDistance <= config.nearPercent;
+    uint32_t next;
+    if (near || slope >= config.fastSlope) {
+      next = period / 2;
+    } else {
+      next = period + period / 4 + 1;
+    }
+    next = next < config.minPeriodMs ? config.minPeriodMs : next;
+    next = next > config.maxPeriodMs ? config.maxPeriodMs : next;
+
+    if (next != period) {
+      changes++;
+      period = next;
+    }
+    return period;
+  }
+
+  uint32_t periodMs() const {
+    return period;
+  }
+
+  // Smoothed rate of change, in volts per minute.
+  float slopePerMinute() const {
+    return slope;
+  }
+
+  // Number of times the period changed.
+  uint32_t rateChanges() const {
+    return changes;
+  }
+
+ private:
+  static constexpr float SLOPE_SMOOTHING = 0.3f;
+
+  AdaptiveRateConfig config;
+  uint32_t period;
+  float slope;
+  float lastVolts;
+  uint32_t lastMs;
+  bool primed;
+  uint32_t changes;
+};
+
+#endif
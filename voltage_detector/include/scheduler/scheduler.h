@@ -0,0 +1,68 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCHEDULER_MAX_TASKS 8
+
+// Returns the current time in microseconds. `micros` on the device, a virtual clock in tests.
+typedef uint32_t (*SchedulerClock)();
+typedef void (*SchedulerTaskFunction)();
+
+// Timing counters for one task, as published for the HTTP handlers.
+struct ScheduledTaskStats {
+  const char *name;
+  uint32_t periodMs;
+  uint32_t runs;
+  uint32_t overruns;       // Runs that started a whole period late; the missed ones are skipped
+  uint32_t maxLatenessUs;  // Worst delay between the deadline and the start of a run
+  uint32_t lastDurationUs;
+  uint32_t maxDurationUs;
+};
+
+struct SchedulerReport {
+  uint32_t count;
+  ScheduledTaskStats tasks[SCHEDULER_MAX_TASKS];
+};
+
+/**
+ * Deadline-based cooperative scheduler. Each task runs at its own fixed rate; `tick` runs whatever is
+ * due, earliest deadline first, and says how long the caller may sleep. Tasks must not block.
+ */
+class Scheduler {
+ public:
+  explicit Scheduler(SchedulerClock clock);
+
+  /**
+   * Registers a periodic task. It first runs on the next `tick`.
+   *
+   * @return The task's index, or -1 if `SCHEDULER_MAX_TASKS` are already registered.
+   */
+  int add(const char *name, uint32_t periodMs, SchedulerTaskFunction run);
+
+  // Changes a task's rate. The new period applies from its next deadline.
+  void setPeriod(int task, uint32_t periodMs);
+
+  /**
+   * Runs every task whose deadline has passed.
+   *
+   * @return Microseconds until the next deadline, 0 if something is already due again.
+   */
+  uint32_t tick();
+
+  SchedulerReport report() const;
+
+ private:
+  struct Task {
+    ScheduledTaskStats stats;
+    SchedulerTaskFunction run;
+    uint32_t nextDueUs;
+  };
+
+  SchedulerClock clock;
+  Task tasks[SCHEDULER_MAX_TASKS];
+  size_t count;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef THREAD_STATS_H
+#define THREAD_STATS_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define THREAD_STATS_MAX_THREADS 4
+
+// CPU share and stack headroom of one FreeRTOS task, as published for the HTTP handlers.
+struct ThreadStats {
+  const char *name;
+  int8_t core;
+  uint8_t priority;
+  uint16_t cpuPermille;     // Share of one core since the previous report
+  uint32_t stackFreeBytes;  // Lowest amount of free stack seen since the task started
+};
+
+struct ThreadReport {
+  uint32_t count;
+  uint32_t samplesDropped;  // Samples the service task was too far behind to take
+  ThreadStats threads[THREAD_STATS_MAX_THREADS];
+};
+
+/**
+ * Time a task has spent doing work, for reporting its CPU share. The Arduino core is built without
+ * FreeRTOS run-time stats, so each task times its own work and adds it here.
+ *
+ * `add` may be called from the measured task while another task calls `sample`; there must only be
+ * one caller of `sample`.
+ */
+class BusyMeter {
+ public:
+  BusyMeter() : busyUs(0), lastBusyUs(0), lastSampledUs(0) {}
+
+  void add(uint32_t us) {
+    busyUs.fetch_add(us, std::memory_order_relaxed);
+  }
+
+  /**
+   * @return The share of time spent busy since the previous call, in thousandths.
+   */
+  uint16_t sample(uint32_t nowUs) {
+    uint32_t busy = busyUs.load(std::memory_order_relaxed);
+    uint32_t elapsedUs = nowUs - lastSampledUs;
+    uint32_t deltaUs = busy - lastBusyUs;
+    lastBusyUs = busy;
+    lastSampledUs = nowUs;
+
+    if (elapsedUs == 0) {
+      return 0;
+    }
+    uint64_t permille = (uint64_t)deltaUs * 1000 / elapsedUs;
+    return permille > 1000 ? 1000 : (uint16_t)permille;
+  }
+
+ private:
+  std::atomic<uint32_t> busyUs;
+  uint32_t lastBusyUs;
+  uint32_t lastSampledUs;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef STATION_TABLE_H
+#define STATION_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define STATION_TABLE_SIZE 16  // Above the ESP32 softAP's hardware limit
+
+// A station as the WiFi driver lists it.
+struct StationListing {
+  uint8_t mac[6];
+  uint32_t ip;  // 0 until DHCP handed out an address
+};
+
+struct StationEntry {
+  uint8_t mac[6];
+  uint32_t ip;
+  uint32_t associatedMs;  // When it first showed up in a listing
+  uint32_t lastActiveMs;  // Last sign of use, or association
+};
+
+struct StationPolicy {
+  uint32_t maxStations;  // The softAP's association limit
+  uint32_t reserve;      // Slots kept free for new arrivals by evicting idle stations
+  uint32_t idleMs;       // Only stations idle at least this long are evicted
+};
+
+// Published for /stations.
+struct StationReport {
+  uint32_t count;
+  uint32_t maxStations;
+  uint32_t associations;
+  uint32_t departures;
+  uint32_t evictions;
+  StationEntry stations[STATION_TABLE_SIZE];
+};
+
+/**
+ * The softAP's associated stations and when each last did something. With more relay nodes than the
+ * softAP has slots, stations that hold a slot without using it are evicted so others can get in; the
+ * nodes come back with their own backoff, or only associate for the length of a query anyway.
+ *
+ * Membership comes only from the driver's station list, passed to `sync` each time, so a missed
+ * event cannot leave an entry behind for a station that is gone.
+ *
+ * Not thread-safe; owned by the service task.
+ */
+class StationTable {
+ public:
+  explicit StationTable(StationPolicy policy) : policy(policy), count(0), associations(0), departures(0), evictions(0) {}
+
+  /**
+   * Brings the table in line with the driver's list: stations no longer listed are dropped, new ones
+   * added as just associated, and addresses updated.
+   */
+  void sync(const StationListing *listed, uint32_t listedCount, uint32_t nowMs) {
+    for (uint32_t i = 0; i < count;) {
+      if (findListed(entries[i].mac, listed, listedCount) < 0) {
+        departures++;
+        entries[i] = entries[--count];
+      } else {
+        i++;
+      }
+    }
+    for (uint32_t j = 0; j < listedCount; j++) {
+      int i = find(listed[j].mac);
+      if (i < 0) {
+        if (count == STATION_TABLE_SIZE) {
+          continue;
+        }
+        associations++;
+        i = count++;
+        memcpy(entries[i].mac, listed[j].mac, sizeof(entries[i].mac));
+        entries[i].associatedMs = nowMs;
+        entries[i].lastActiveMs = nowMs;
+      }
+      entries[i].ip = listed[j].ip;
+    }
+  }
+
+  // Records use of station `i` at `atMs`, unless it already has a later one.
+  void touch(uint32_t i, uint32_t atMs) {
+    if ((int32_t)(atMs - entries[i].lastActiveMs) > 0) {
+      entries[i].lastActiveMs = atMs;
+    }
+  }
+
+  // The same for the station with address `mac`, if it is in the table.
+  void touchMac(const uint8_t mac[6], uint32_t atMs) {
+    int i = find(mac);
+    if (i >= 0) {
+      touch(i, atMs);
+    }
+  }
+
+  /**
+   * Picks the station to evict, if the softAP is within `reserve` slots of full: the one idle longest,
+   * provided it has been idle for `idleMs`.
+   *
+   * @return Its index, or -1 if none should go.
+   */
+  int pickEviction(uint32_t nowMs) const {
+    if (count + policy.reserve < policy.maxStations) {
+      return -1;
+    }
+    int idlest = -1;
+    uint32_t idlestMs = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t idle = nowMs - entries[i].lastActiveMs;
+      if (idle >= policy.idleMs && (idlest < 0 || idle > idlestMs)) {
+        idlest = i;
+        idlestMs = idle;
+      }
+    }
+    return idlest;
+  }
+
+  /**
+   * Counts an eviction of station `i` and gives it a fresh idle time, so it is not picked again while
+   * its deauthentication is on the way.
+   */
+  void evicted(int i, uint32_t nowMs) {
+    evictions++;
+    entries[i].lastActiveMs = nowMs;
+  }
+
+  const StationEntry &entry(int i) const {
+    return entries[i];
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+  StationReport report() const {
+    StationReport report = {};
+    report.count = count;
+    report.maxStations = policy.maxStations;
+    report.associations = associations;
+    report.departures = departures;
+    report.evictions = evictions;
+    memcpy(report.stations, entries, count * sizeof(StationEntry));
+    return report;
+  }
+
+ private:
+  int find(const uint8_t mac[6]) const {
+    for (uint32_t i = 0; i < count; i++) {
+      if (memcmp(entries[i].mac, mac, 6) == 0) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  static int findListed(const uint8_t mac[6], const StationListing *listed, uint32_t listedCount) {
+    for (uint32_t j = 0; j < listedCount; j++) {
+      if (memcmp(listed[j].mac, mac, 6) == 0) {
+        return j;
+      }
+    }
+    return -1;
+  }
+
+  StationPolicy policy;
+  StationEntry entries[STATION_TABLE_SIZE];
+  uint32_t count;
+  uint32_t associations;
+  uint32_t departures;
+  uint32_t evictions;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef TELEMETRY_STATE_H
+#define TELEMETRY_STATE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <telemetry/windowed_stats.h>
+
+/**
+ * Single-writer, multi-reader snapshot of a small struct. The writer fills the copy readers are not
+ * using and then flips `active`, and each copy carries its own sequence number so a reader can tell
+ * when the copy it just read was rewritten underneath it.
+ *
+ * With two copies a reader never waits for a writer that got preempted halfway through, which matters
+ * here: the async TCP task reading the snapshot runs at a higher priority than the service task writing
+ * it, and a plain seqlock would let it spin on an odd sequence forever.
+ *
+ * The payload is stored as atomic words, so `read` and `write` are free of data races. The ordering
+ * comes from release stores and acquire loads of those words rather than fences, which also lets
+ * ThreadSanitizer check it (see test/test_seqlock).
+ */
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock payload must be trivially copyable");
+
+ public:
+  Seqlock() : active(0) {
+    for (int b = 0; b < 2; b++) {
+      buffers[b].sequence.store(0, std::memory_order_relaxed);
+      for (size_t i = 0; i < WORDS; i++) {
+        buffers[b].words[i].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Only ever called from one task.
+  void write(const T &value) {
+    uint32_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+
+    int target = 1 - active.load(std::memory_order_relaxed);
+    Buffer &buffer = buffers[target];
+    uint32_t sequence = buffer.sequence.load(std::memory_order_relaxed);
+
+    buffer.sequence.store(sequence + 1, std::memory_order_relaxed);
+    for (size_t i = 0; i < WORDS; i++) {
+      // Release keeps the odd sequence above from being seen after the word
+      buffer.words[i].store(words[i], std::memory_order_release);
+    }
+    buffer.sequence.store(sequence + 2, std::memory_order_release);
+    active.store(target, std::memory_order_release);
+  }
+
+  // Safe from any task; returns a copy that was published as a whole.
+  T read() const {
+    uint32_t words[WORDS];
+    for (;;) {
+      const Buffer &buffer = buffers[active.load(std::memory_order_acquire)];
+      uint32_t before = buffer.sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;  // The writer has lapped us and is filling this copy again
+      }
+      for (size_t i = 0; i < WORDS; i++) {
+        // Acquire keeps the sequence check below from moving ahead of the word, and makes a word from a
+        // newer write carry that write's odd sequence with it
+        words[i] = buffer.words[i].load(std::memory_order_acquire);
+      }
+      if (buffer.sequence.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+ private:
+  static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+  struct Buffer {
+    std::atomic<uint32_t> sequence;  // Odd while being written
+    std::atomic<uint32_t> words[WORDS];
+  };
+
+  Buffer buffers[2];
+  std::atomic<int> active;
+};
+
+#define TELEMETRY_WINDOW_COUNT 3  // 1 min, 15 min and 1 h of voltage history
+#define THRESHOLD_SET_SIZE 24     // Registered devices plus the monitor's own switch-off threshold
+
+// Live values shown by the HTTP endpoints. Written by the service task, read by the async TCP task.
+struct Telemetry {
+  float voltage;
+  float percentage;
+  float systemType;
+  int setPercentageForOff;
+  uint32_t sampleCount;
+  uint32_t sampledAtMs;
+  StatsSummary voltageWindows[TELEMETRY_WINDOW_COUNT];
+};
+
+// Switch-off thresholds, in percent, that the sampling task watches. Written by the service task
+// whenever the registry or `setPercentageForOff` changes.
+struct ThresholdSet {
+  uint32_t count;
+  uint8_t values[THRESHOLD_SET_SIZE];
+};
+
+#define DEVICE_TABLE_SIZE 20     // Same as MAX_DEVICES in main.cpp
+#define DEVICE_TABLE_ID_SIZE 20  // Same as DEVICE_ID_SIZE; an ID of full length has no terminator
+
+struct DeviceEntry {
+  char deviceId[DEVICE_TABLE_ID_SIZE];
+  uint8_t threshold;
+  uint8_t block;  // Index of its EEPROM block
+};
+
+// The registered devices with their thresholds, so HTTP handlers answer without touching the EEPROM.
+// Written by the service task whenever the registry may have changed.
+struct DeviceTable {
+  uint32_t count;
+  DeviceEntry devices[DEVICE_TABLE_SIZE];
+};
+
+// The entry of `deviceId`, or NULL if it is not registered.
+inline const DeviceEntry *findDevice(const DeviceTable &table, const char *deviceId) {
+  if (strlen(deviceId) > DEVICE_TABLE_ID_SIZE) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < table.count; i++) {
+    if (strncmp(table.devices[i].deviceId, deviceId, DEVICE_TABLE_ID_SIZE) == 0) {
+      return &table.devices[i];
+    }
+  }
+  return NULL;
+}
+
+#endif
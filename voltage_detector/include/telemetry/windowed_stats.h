@@ -0,0 +1,155 @@
+#ifndef WINDOWED_STATS_H
+#define WINDOWED_STATS_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_MAX_BUCKETS 15
+
+// Aggregates reported for one window.
+struct StatsSummary {
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  uint32_t count;
+};
+
+/**
+ * Welford running mean/variance plus min and max. Two accumulators can be merged, which is what lets
+ * `WindowedStats` keep a window as a handful of buckets instead of every sample.
+ */
+struct RunningStats {
+  uint32_t count;
+  float mean;
+  float m2;  // Sum of squared differences from the mean
+  float min;
+  float max;
+
+  void reset() {
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    min = 0;
+    max = 0;
+  }
+
+  void add(float value) {
+    if (count == 0) {
+      min = value;
+      max = value;
+    } else {
+      min = value < min ? value : min;
+      max = value > max ? value : max;
+    }
+    count++;
+    float delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+  }
+
+  // Chan et al. parallel combination of two Welford accumulators.
+  void merge(const RunningStats &other) {
+    if (other.count == 0) {
+      return;
+    }
+    if (count == 0) {
+      *this = other;
+      return;
+    }
+    uint32_t total = count + other.count;
+    float delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * ((float)count * other.count / total);
+    min = other.min < min ? other.min : min;
+    max = other.max > max ? other.max : max;
+    count = total;
+  }
+
+  StatsSummary summary() const {
+    StatsSummary result;
+    result.min = min;
+    result.max = max;
+    result.mean = mean;
+    result.stddev = count > 1 ? sqrtf(m2 / (count - 1)) : 0;
+    result.count = count;
+    return result;
+  }
+};
+
+/**
+ * Sliding-window statistics kept as a ring of closed buckets plus the bucket being filled. `closed`
+ * caches the merge of the ring and is only rebuilt when a bucket closes, so adding a sample and
+ * reading the summary are both O(1) as long as a bucket spans at least one sample period.
+ *
+ * The window covers the last `bucketCount` full buckets plus the current partial one, so it is exact
+ * to within one bucket.
+ */
+class WindowedStats {
+ public:
+  WindowedStats(uint32_t bucketMs, size_t bucketCount)
+      : bucketMs(bucketMs), bucketCount(bucketCount > STATS_MAX_BUCKETS ? STATS_MAX_BUCKETS : bucketCount),
+        head(0), bucketStartMs(0), started(false) {
+    for (size_t i = 0; i < STATS_MAX_BUCKETS; i++) {
+      buckets[i].reset();
+    }
+    current.reset();
+    closed.reset();
+  }
+
+  void add(float value, uint32_t nowMs) {
+    if (!started) {
+      bucketStartMs = nowMs;
+      started = true;
+    }
+    advance(nowMs);
+    current.add(value);
+  }
+
+  StatsSummary summary() const {
+    RunningStats window = closed;
+    window.merge(current);
+    return window.summary();
+  }
+
+ private:
+  // Closes every bucket that ended before `nowMs`, dropping the oldest ones out of the window.
+  void advance(uint32_t nowMs) {
+    uint32_t elapsed = (nowMs - bucketStartMs) / bucketMs;
+    if (elapsed == 0) {
+      return;
+    }
+
+    if (elapsed > bucketCount) {
+      // Even the bucket being filled has left the window
+      for (size_t i = 0; i < bucketCount; i++) {
+        buckets[i].reset();
+      }
+      current.reset();
+    } else {
+      for (size_t i = 0; i < elapsed; i++) {
+        buckets[head] = current;
+        head = (head + 1) % bucketCount;
+        current.reset();  // Buckets skipped without samples stay empty
+      }
+    }
+    bucketStartMs += elapsed * bucketMs;
+
+    closed.reset();
+    for (size_t i = 0; i < bucketCount; i++) {
+      closed.merge(buckets[i]);
+    }
+  }
+
+  uint32_t bucketMs;
+  size_t bucketCount;
+  RunningStats buckets[STATS_MAX_BUCKETS];
+  RunningStats current;
+  RunningStats closed;
+  size_t head;
+  uint32_t bucketStartMs;
+  bool started;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <telemetry_wire.h>
+
+enum WireFormat {
+  WIRE_FORMAT_JSON,
+  WIRE_FORMAT_MSGPACK,
+  WIRE_FORMAT_BINARY,
+};
+
+WireFormat negotiateWireFormat(AsyncWebServerRequest *request);
+DeserializationError parseRequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, JsonDocument &doc);
+void sendDocument(AsyncWebServerRequest *request, int code, JsonDocument &doc, WireFormat format);
+void sendFrame(AsyncWebServerRequest *request, int code, const void *frame, size_t len);
+void sendSuccess(AsyncWebServerRequest *request, int code, const char *message);
+void sendError(AsyncWebServerRequest *request, int code, const char *message);
+void sendAccepted(AsyncWebServerRequest *request, uint32_t seq, const char *message);
+
+#endif
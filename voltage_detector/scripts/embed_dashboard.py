@@ -0,0 +1,78 @@
+"""Embeds the browser dashboard in web/ into the firmware as gzip-compressed arrays.
+
+Runs as a PlatformIO pre-build script (see extra_scripts in platformio.ini) and
+writes include/dashboard/dashboard_assets.h. It can also be run by hand:
+
+    python scripts/embed_dashboard.py
+
+app.js is served under a content-hashed path so browsers may cache it forever;
+index.html is small and revalidated with an ETag instead.
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+
+def compress(data):
+    # mtime=0 keeps the output identical between builds of the same sources.
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return (
+        "const uint8_t %s[] PROGMEM = {\n%s\n};\n"
+        "const size_t %s_LEN = %d;\n" % (name, "\n".join(lines), name, len(data))
+    )
+
+
+def generate(project_dir):
+    web_dir = os.path.join(project_dir, "web")
+    out_path = os.path.join(project_dir, "include", "dashboard", "dashboard_assets.h")
+
+    with open(os.path.join(web_dir, "app.js"), "rb") as f:
+        app_js = f.read()
+    app_js_path = "/app.%s.js" % hashlib.sha1(app_js).hexdigest()[:10]
+
+    with open(os.path.join(web_dir, "index.html"), "rb") as f:
+        index_html = f.read().replace(b"{{APP_JS}}", app_js_path.encode())
+    etag = hashlib.sha1(index_html).hexdigest()[:16]
+
+    header = (
+        "// Generated by scripts/embed_dashboard.py from web/. Do not edit.\n"
+        "#ifndef DASHBOARD_ASSETS_H\n"
+        "#define DASHBOARD_ASSETS_H\n\n"
+        "#include <Arduino.h>\n\n"
+        '#define DASHBOARD_INDEX_ETAG "\\"%s\\""\n'
+        '#define DASHBOARD_APP_JS_PATH "%s"\n\n'
+        "%s\n%s\n"
+        "#endif\n"
+        % (
+            etag,
+            app_js_path,
+            c_array("DASHBOARD_INDEX_HTML_GZ", compress(index_html)),
+            c_array("DASHBOARD_APP_JS_GZ", compress(app_js)),
+        )
+    )
+
+    # Leave the file alone when nothing changed so it does not trigger a rebuild.
+    if os.path.exists(out_path):
+        with open(out_path) as f:
+            if f.read() == header:
+                return
+    os.makedirs(os.path.dirname(out_path), exist_ok=True)
+    with open(out_path, "w") as f:
+        f.write(header)
+    print("Embedded dashboard: index.html %d bytes, app.js %d bytes (gzip)"
+          % (len(compress(index_html)), len(compress(app_js))))
+
+
+try:
+    Import("env")  # noqa: F821 - injected by PlatformIO
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    generate(os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0]))))
@@ -0,0 +1,192 @@
+#include <lcd_frame/i2c_lcd.h>
+
+#include <Wire.h>
+
+// PCF8574 pins: P0 = RS, P1 = RW, P2 = EN, P3 = backlight, P4-P7 = D4-D7
+#define PCF_RS 0x01
+#define PCF_EN 0x04
+#define PCF_BACKLIGHT 0x08
+
+// Queue entries: a byte for the controller plus flags
+#define ENTRY_DATA 0x100       // RS high: character data rather than a command
+#define ENTRY_BACKLIGHT 0x200  // Not sent to the controller; bit 0 is the new backlight state
+
+#define LCD_SET_DDRAM_ADDR 0x80
+
+#define I2C_LCD_STACK_SIZE 2048
+
+I2cLcd::I2cLcd(uint8_t address)
+    : address(address),
+      backlightBit(PCF_BACKLIGHT),
+      busHz(0),
+      task(NULL),
+      pending(0),
+      overflowed(false),
+      transactions(0),
+      bytes(0),
+      nackAddress(0),
+      nackData(0),
+      timeouts(0),
+      otherErrors(0),
+      overflows(0) {}
+
+void I2cLcd::begin(uint32_t busHz, BaseType_t core, UBaseType_t priority) {
+  this->busHz = busHz;
+  Wire.begin();
+  Wire.setClock(busHz);
+
+  // Power-on reset into 4-bit mode, HD44780 datasheet figure 24.
+  delay(50);
+  sendNibble(0x03);
+  delayMicroseconds(4500);
+  sendNibble(0x03);
+  delayMicroseconds(4500);
+  sendNibble(0x03);
+  delayMicroseconds(150);
+  sendNibble(0x02);
+
+  const uint16_t init[] = {
+    0x28,  // Function set: 4-bit, 2 lines, 5x8 font
+    0x0C,  // Display on, cursor and blink off
+    0x06,  // Entry mode: increment, no shift
+    0x01,  // Clear
+  };
+  transmit(init, sizeof(init) / sizeof(init[0]));
+  delayMicroseconds(2000);  // Clear takes 1.52 ms, everything else well under the time a bus byte takes
+
+  xTaskCreatePinnedToCore(drainTask, "lcd", I2C_LCD_STACK_SIZE, this, priority, &task, core);
+}
+
+void I2cLcd::setCursor(uint8_t col, uint8_t row) {
+  static const uint8_t rowOffsets[LCD_ROWS] = {0x00, 0x40};
+  enqueue(LCD_SET_DDRAM_ADDR | (col + rowOffsets[row % LCD_ROWS]));
+  notify();
+}
+
+void I2cLcd::write(const char *text, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    enqueue(ENTRY_DATA | (uint8_t)text[i]);
+  }
+  notify();
+}
+
+void I2cLcd::setBacklight(bool on) {
+  enqueue(ENTRY_BACKLIGHT | (on ? 1 : 0));
+  notify();
+}
+
+bool I2cLcd::takeOverflow() {
+  return overflowed.exchange(false, std::memory_order_relaxed);
+}
+
+I2cLcdStats I2cLcd::stats() const {
+  I2cLcdStats stats;
+  stats.busHz = busHz;
+  stats.transactions = transactions.load(std::memory_order_relaxed);
+  stats.bytes = bytes.load(std::memory_order_relaxed);
+  stats.nackAddress = nackAddress.load(std::memory_order_relaxed);
+  stats.nackData = nackData.load(std::memory_order_relaxed);
+  stats.timeouts = timeouts.load(std::memory_order_relaxed);
+  stats.otherErrors = otherErrors.load(std::memory_order_relaxed);
+  stats.overflows = overflows.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void I2cLcd::enqueue(uint16_t entry) {
+  pending.fetch_add(1, std::memory_order_relaxed);
+  if (!queue.push(entry)) {
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    overflows.fetch_add(1, std::memory_order_relaxed);
+    overflowed.store(true, std::memory_order_relaxed);
+  }
+}
+
+void I2cLcd::notify() {
+  if (task != NULL) {
+    xTaskNotifyGive(task);
+  }
+}
+
+/**
+ * The function `drainTask` sleeps until something is queued, then sends the queue in batches of up
+ * to `I2C_LCD_BATCH` bytes per I2C transaction.
+ */
+void I2cLcd::drainTask(void *arg) {
+  I2cLcd *lcd = (I2cLcd *)arg;
+  uint16_t batch[I2C_LCD_BATCH];
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    size_t count;
+    do {
+      count = 0;
+      while (count < I2C_LCD_BATCH && lcd->queue.pop(batch[count])) {
+        count++;
+      }
+      if (count > 0) {
+        lcd->transmit(batch, count);
+        lcd->pending.fetch_sub(count, std::memory_order_release);
+      }
+    } while (count == I2C_LCD_BATCH);
+  }
+}
+
+/**
+ * The function `transmit` sends queue entries in one I2C transaction. Each controller byte goes out as
+ * two nibbles, each clocked in by raising and dropping EN, so four bus bytes per controller byte. At
+ * 100 kHz that is about 360 us per byte, well over the 37 us the controller needs between writes.
+ */
+void I2cLcd::transmit(const uint16_t *entries, size_t count) {
+  size_t sent = 0;
+
+  Wire.beginTransmission(address);
+  for (size_t i = 0; i < count; i++) {
+    uint16_t entry = entries[i];
+    if (entry & ENTRY_BACKLIGHT) {
+      backlightBit = (entry & 1) ? PCF_BACKLIGHT : 0;
+      Wire.write(backlightBit);
+      continue;
+    }
+
+    uint8_t rs = (entry & ENTRY_DATA) ? PCF_RS : 0;
+    uint8_t value = entry & 0xFF;
+    uint8_t high = (value & 0xF0) | rs | backlightBit;
+    uint8_t low = (value << 4) | rs | backlightBit;
+    Wire.write(high | PCF_EN);
+    Wire.write(high);
+    Wire.write(low | PCF_EN);
+    Wire.write(low);
+    sent++;
+  }
+  uint8_t error = Wire.endTransmission();
+
+  transactions.fetch_add(1, std::memory_order_relaxed);
+  switch (error) {
+    case 0:
+      bytes.fetch_add(sent, std::memory_order_relaxed);
+      return;
+    case 2:
+      nackAddress.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case 3:
+      nackData.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case 5:
+      timeouts.fetch_add(1, std::memory_order_relaxed);
+      break;
+    default:
+      otherErrors.fetch_add(1, std::memory_order_relaxed);
+      break;
+  }
+  overflowed.store(true, std::memory_order_relaxed);  // The display is out of step; have it redrawn
+}
+
+// Used during initialization only, while the controller still expects 8-bit writes.
+void I2cLcd::sendNibble(uint8_t nibble) {
+  uint8_t bits = (nibble << 4) | backlightBit;
+  Wire.beginTransmission(address);
+  Wire.write(bits | PCF_EN);
+  Wire.write(bits);
+  Wire.endTransmission();
+}
@@ -0,0 +1,84 @@
+#include <lcd_frame/lcd_frame.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+LcdFrame::LcdFrame() {
+  clear();
+}
+
+void LcdFrame::clear() {
+  memset(cells, ' ', sizeof(cells));
+}
+
+void LcdFrame::print(uint8_t col, uint8_t row, const char *text) {
+  if (row >= LCD_ROWS) {
+    return;
+  }
+  for (; col < LCD_COLS && *text != 0; col++, text++) {
+    cells[row][col] = *text;
+  }
+}
+
+void LcdFrame::printf(uint8_t col, uint8_t row, const char *format, ...) {
+  char buffer[LCD_COLS + 1];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  print(col, row, buffer);
+}
+
+bool LcdFrame::operator==(const LcdFrame &other) const {
+  return memcmp(cells, other.cells, sizeof(cells)) == 0;
+}
+
+LcdRenderer::LcdRenderer(LcdSink &sink) : sink(sink), valid(false), totalBytes(0) {}
+
+void LcdRenderer::invalidate() {
+  valid = false;
+}
+
+size_t LcdRenderer::render(const LcdFrame &frame) {
+  size_t bytes = 0;
+  int cursorCol = -1;
+  int cursorRow = -1;
+
+  for (uint8_t row = 0; row < LCD_ROWS; row++) {
+    uint8_t col = 0;
+    while (col < LCD_COLS) {
+      if (valid && frame.cells[row][col] == shown.cells[row][col]) {
+        col++;
+        continue;
+      }
+
+      // Extend the run over changed cells and over single unchanged cells between them.
+      uint8_t end = col + 1;
+      while (end < LCD_COLS) {
+        if (!valid || frame.cells[row][end] != shown.cells[row][end]) {
+          end++;
+        } else if (end + 1 < LCD_COLS && frame.cells[row][end + 1] != shown.cells[row][end + 1]) {
+          end += 2;
+        } else {
+          break;
+        }
+      }
+
+      if (cursorRow != row || cursorCol != col) {
+        sink.setCursor(col, row);
+        bytes++;
+      }
+      sink.write(&frame.cells[row][col], end - col);
+      bytes += end - col;
+      cursorRow = row;
+      cursorCol = end;
+      col = end;
+    }
+  }
+
+  shown = frame;
+  valid = true;
+  totalBytes += bytes;
+  return bytes;
+}
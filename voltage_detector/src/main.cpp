@@ -1,10 +1,34 @@
 #include <Arduino.h>
 #include <WiFi.h>
+#include <WiFiUdp.h>
 #include <cmath>
 #include <EEPROM.h>
-#include <LiquidCrystal_I2C.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+#include <espnow_transport.h>
+#include <command_queue/command_queue.h>
+#include <dashboard/dashboard_assets.h>
+#include <input/button_machine.h>
+#include <lcd_frame/i2c_lcd.h>
+#include <lcd_frame/lcd_frame.h>
+#include <nodes/node_status.h>
+#include <poll_schedule/poll_schedule.h>
+#include <power/power_policy.h>
+#include <radio/radio_report.h>
+#include <rate_limit/rate_limiter.h>
+#include <sampling/adaptive_rate.h>
+#include <scheduler/scheduler.h>
+#include <scheduler/thread_stats.h>
+#include <stations/station_table.h>
+#include <telemetry/telemetry_state.h>
+#include <wire_format/wire_format.h>
 
 #define R1 100000.0 // Resistor R1 value in ohms
 #define R2 5600.0   // Resistor R2 value in ohms
@@ -13,32 +37,263 @@
 #define UP_PIN 5
 #define DOWN_PIN 19
 
+#define BUTTON_DEBOUNCE_MS 20
+#define BUTTON_LONG_PRESS_MS 500  // UP and DOWN start repeating after this long
+#define BUTTON_REPEAT_MS 100
+
 #define MAX_DEVICES 20
 #define DEVICE_BLOCK_SIZE 20  // 16 bytes for device ID, 4 bytes for voltage
 #define DEVICE_ID_SIZE 20
 #define VOLTAGE_SIZE 4
+#define COMMAND_QUEUE_SIZE 16
+#define MAX_BATCH_DEVICE_IDS 8  // Per /getVoltageByIds request
+static_assert(MAX_DEVICES <= DEVICE_TABLE_SIZE && DEVICE_ID_SIZE == DEVICE_TABLE_ID_SIZE, "DeviceTable must mirror the EEPROM registry");
+
+// Poll schedules handed to relay nodes with every /getVoltageById(s) reply
+#define POLL_MIN_INTERVAL_MS 10000
+#define POLL_MAX_INTERVAL_MS 120000
+#define POLL_NEAR_PERCENT 5.0
+#define POLL_FAR_PERCENT 30.0
+
+// Sampling and estimation run on their own high-priority task on the application core; networking,
+// display, commands and persistence share the protocol core so HTTP load cannot delay a sample.
+#define SAMPLER_CORE 1
+#define SAMPLER_PRIORITY 5
+#define SAMPLER_STACK_SIZE 3072
+#define SERVICE_CORE 0    // Same core as WiFi and the async TCP task, see platformio.ini
+#define SERVICE_PRIORITY 1
+#define SERVICE_STACK_SIZE 6144
+#define SAMPLE_QUEUE_SIZE 8
+#define LCD_PRIORITY 2    // Above the service task, so queued screen updates go out right away
+
+#ifndef LCD_I2C_HZ
+#define LCD_I2C_HZ 100000  // The PCF8574's rated maximum
+#endif
+
+// The sampling period adapts between these bounds, see AdaptiveRate
+#define SAMPLE_MIN_PERIOD_MS 250
+#define SAMPLE_MAX_PERIOD_MS 10000
+#define SAMPLE_NOISE_VOLTS 0.1   // About 6 ADC steps through the divider
+#define SAMPLE_FAST_SLOPE 0.5    // Volts per minute
+#define SAMPLE_NEAR_PERCENT 3.0  // Percentage points from a threshold
+
+// Periods of the service task's scheduled jobs, in milliseconds. The slow variants apply in low power
+// mode while nobody is using the monitor.
+#define DISPLAY_PERIOD_MS 250
+#define DISPLAY_SLOW_PERIOD_MS 1000
+#define COMMAND_PERIOD_MS 20    // Also bounds the latency of button presses
+#define COMMAND_SLOW_PERIOD_MS 200
+#define PERSIST_PERIOD_MS 30000
+#define STATS_PERIOD_MS 10000
+#define POWER_PERIOD_MS 250
+
+#define CPU_FAST_MHZ 240
+#define CPU_SLOW_MHZ 80  // Lowest clock that keeps WiFi running
+
+#define EVENT_HEARTBEAT_MS 15000  // Longest gap between two /events messages
+#define RADIO_PERIOD_MS 50        // How often relay acknowledgements are taken off the queue
+#define RADIO_ACK_QUEUE_SIZE 16
+#define RADIO_ACK_WINDOW 4        // Telemetry frames back that a late acknowledgement is still taken for
+
+// softAP capacity. The ESP32 takes at most 10 stations (ESP_WIFI_MAX_CONN_NUM) but only lets 4 in
+// unless asked, far fewer than the devices the registry holds.
+#define SOFTAP_CHANNEL 1
+#define SOFTAP_MAX_STATIONS 10
+#define STATION_RESERVE 2          // Slots kept free for arriving nodes by evicting idle stations
+// Only stations idle this long are evicted. Relay nodes that follow /events or the beacon still poll
+// every 5 minutes as a heartbeat (FALLBACK_POLL_MS in control_switch), so quiet followers stay clear.
+#define STATION_IDLE_MS 900000
+#define STATION_PERIOD_MS 1000
+
+#define MESSAGE_SHOW_MS 500     // How long mode change messages stay on screen
 
 int setPercentageOffAddress = 2;
 int systemTypeAddress = 0;
 int percentageAddress = 1;
+int lowPowerAddress = MAX_DEVICES * DEVICE_BLOCK_SIZE;  // Past the device blocks
+int bootCountAddress = lowPowerAddress + 1;              // uint32_t, the radio epoch of the last boot
 bool inVoltageSettingMode = false;  // Flag to track if we're in the setting mode
-
+LcdFrame messageFrame;              // Shown instead of the normal screens until messageUntilMs
+uint32_t messageUntilMs = 0;
+
+enum ButtonId {
+  BUTTON_MENU,
+  BUTTON_UP,
+  BUTTON_DOWN,
+  BUTTON_COUNT,
+};
+
+// Edge interrupts restart each button's one-shot timer, whose callback runs the button's state machine
+// on the timer task and queues the events for applyCommands(). Nothing runs while no button is touched.
+const uint8_t buttonPins[BUTTON_COUNT] = {MENU_PIN, UP_PIN, DOWN_PIN};
+ButtonMachine buttons[BUTTON_COUNT] = {
+  ButtonMachine(ButtonTiming{BUTTON_DEBOUNCE_MS, 0, 0}),
+  ButtonMachine(ButtonTiming{BUTTON_DEBOUNCE_MS, BUTTON_LONG_PRESS_MS, BUTTON_REPEAT_MS}),
+  ButtonMachine(ButtonTiming{BUTTON_DEBOUNCE_MS, BUTTON_LONG_PRESS_MS, BUTTON_REPEAT_MS}),
+};
+TimerHandle_t buttonTimers[BUTTON_COUNT];
+
+// Working state owned by the service task. Other tasks read the published copy in `telemetry`.
 float percentage;
 int setPercentageForOff;
+int publishedPercentageForOff = -1;  // As of the last publishThresholds(); set mode changes it locally first
 float systemType;
+float lastVoltage = 0;
+uint32_t sampleCount = 0;
+uint32_t lastSampleMs = 0;
+
+// Voltage aggregates published with every sample, see /getvoltage?window=
+const char *const voltageWindowNames[TELEMETRY_WINDOW_COUNT] = {"1m", "15m", "1h"};
+WindowedStats voltageWindows[TELEMETRY_WINDOW_COUNT] = {
+  WindowedStats(5000, 12),     // 1 min in 5 s buckets
+  WindowedStats(60000, 15),    // 15 min in 1 min buckets
+  WindowedStats(300000, 12),   // 1 h in 5 min buckets
+};
 
 // Create WiFi server
 AsyncWebServer server(80);
-LiquidCrystal_I2C lcd(0x27, 16, 2);  // Set the LCD address to 0x27 for a 16x2 display
+
+// Relay nodes subscribe here and react to changes instead of polling, see publishEvents().
+AsyncEventSource events("/events");
+uint32_t thresholdGeneration = 0;  // Bumped by publishThresholds(), so subscribers know to refetch theirs
+
+// ESP-NOW link to the relay nodes, alongside /events. Telemetry and thresholds go out as signed
+// broadcast frames without any connection, and each node answers with its relay state. The frames are
+// built and sent by the service task; the receive callback only checks acknowledgements and queues
+// them for radioTask().
+EspNowTransport radio;
+const uint8_t radioKey[SIPHASH_KEY_SIZE] = WIRE_RADIO_KEY;
+uint32_t radioEpoch = 0;  // Boot counter, so nodes can tell a restarted `radioSeq` from a replay
+uint32_t radioSeq = 0;
+uint32_t radioTelemetrySeq = 0;  // Seq of the last telemetry frame, which acknowledgements are matched to
+uint32_t radioRecentTelemetry[RADIO_ACK_WINDOW] = {};  // Seqs of the last telemetry frames; 0 is never sent
+uint32_t radioRecentCount = 0;
+int64_t radioSentUs = 0;         // When it went out
+WireRadioThresholdsFrame radioThresholds[(MAX_DEVICES + WIRE_RADIO_THRESHOLDS_MAX - 1) / WIRE_RADIO_THRESHOLDS_MAX];
+uint32_t radioThresholdPages = 0;
+MpscQueue<RadioAck, RADIO_ACK_QUEUE_SIZE> radioAcks;
+std::atomic<uint32_t> radioBadFrames(0);
+std::atomic<uint32_t> radioAcksDropped(0);
+RadioReport radioState = {};
+Seqlock<RadioReport> radioReport;
+
+// The same telemetry as a UDP multicast beacon, for relay nodes on the IP side. Sent with the radio
+// frames, sharing their epoch but numbered in a sequence of their own.
+WiFiUDP beaconUdp;
+uint32_t thresholdTableHash = WIRE_FNV_OFFSET;
+uint32_t beaconSeq = 0;  // Counted apart from `radioSeq`, so each transport's sequence has no gaps
+std::atomic<uint32_t> beaconsSent(0);
+
+// Stations on the softAP. stationTask() rebuilds the table from the driver's station list, and evicts
+// the idlest station once the softAP is close to full so a node arriving for a query still gets a
+// slot. Requests and /events subscriptions only stamp `stationSeenMs` for the client's address, indexed
+// by its last octet within the softAP's /24, so activity costs one store however many requests come in.
+// ESP-NOW acknowledgements count too, matched by address in radioTask().
+std::atomic<uint32_t> stationSeenMs[256];
+StationTable stations(StationPolicy{SOFTAP_MAX_STATIONS, STATION_RESERVE, STATION_IDLE_MS});
+Seqlock<StationReport> stationReport;
+
+// Screens are drawn into an LcdFrame and only the cells that changed are queued for the display task.
+I2cLcd lcd(0x27);  // PCF8574 backpack at 0x27
+LcdRenderer lcdRenderer(lcd);
+
+// HTTP handlers run on the async TCP task, so they never touch settings or EEPROM themselves. They
+// queue a command instead and the service task applies it.
+MpscQueue<Command, COMMAND_QUEUE_SIZE> commandQueue;
+CommandAcks commandAcks;
+Seqlock<Telemetry> telemetry;
+
+// Each device polls in its own slot of the interval, so nodes that boot together after an outage do not
+// keep arriving together. `pollArrivals` records when the polls actually come, see /pollHistogram.
+const PollScheduleConfig pollSchedule = {POLL_MIN_INTERVAL_MS, POLL_MAX_INTERVAL_MS, POLL_NEAR_PERCENT, POLL_FAR_PERCENT};
+ArrivalHistogram pollArrivals;
+NodeStatusTable nodeStatus;  // What each node reports in its poll, see /nodes
+
+// Per-client budgets, so one misbehaving app or relay node cannot starve the others or wear out the
+// flash with writes.
+RateLimiter rateLimiter(RateBudget{120, 20}, RateBudget{12, 4});
+
+uint32_t schedulerClock() {
+  return micros();
+}
+
+// Everything the service task does runs as a periodic job of this scheduler; see setup().
+Scheduler scheduler(schedulerClock);
+Seqlock<SchedulerReport> schedulerReport;
+
+// One reading with the estimates derived from it, passed from the sampler to the service task.
+struct Sample {
+  float voltage;
+  float systemType;  // 0 when the voltage matches no known system
+  float percentage;
+  uint32_t sampledAtMs;
+};
+
+QueueHandle_t sampleQueue;
+TaskHandle_t samplerHandle;
+TaskHandle_t serviceHandle;
+BusyMeter samplerBusy;
+BusyMeter serviceBusy;
+std::atomic<uint32_t> samplesDropped(0);
+Seqlock<ThreadReport> threadReport;
+
+// Owned by the sampler, which samples faster while the battery moves or nears a threshold.
+AdaptiveRate samplingRate(AdaptiveRateConfig{SAMPLE_MIN_PERIOD_MS, SAMPLE_MAX_PERIOD_MS, SAMPLE_NOISE_VOLTS, SAMPLE_FAST_SLOPE, SAMPLE_NEAR_PERCENT});
+Seqlock<SamplingReport> samplingReport;
+Seqlock<ThresholdSet> thresholds;
+Seqlock<DeviceTable> deviceTable;  // What /getVoltageById(s) answer from
+std::atomic<uint32_t> nextSampleMs(0);  // When the sampler wakes up next, for the power manager
+
+// Low power mode: CPU clock scaling, backlight timeout and light sleep while nobody is around. The
+// state below is owned by the service task; `lastRequestMs` is set by the HTTP handlers.
+PowerPolicy powerPolicy(PowerPolicyConfig{30000, 5000, 60000, 20, 200, 100});
+const PowerProfile powerProfile = {115, 85, 0.8, 20};
+bool lowPowerMode = false;  // Opt-in through POST /power, kept in EEPROM
+std::atomic<uint32_t> lastRequestMs(0);
+PowerReport power = {};
+int64_t powerAccountedUs = 0;
+uint64_t sleepAccountedUs = 0;
+Seqlock<PowerReport> powerReport;
+int commandJob;
+int displayJob;
 
 // Function prototypes
 float getVoltage();
 float detectBatteryType(float voltage);
 float calculateBatteryPercentage(float voltage, float systemType);
 void displayOnLCD(float voltage, float percentage);
-void buttonToSetPercentageOff();
+void setupButtons();
+void handleButtonEvent(ButtonId button, ButtonEvent event);
+void samplerTask(void *arg);
+void serviceTask(void *arg);
+void applySample(const Sample &sample);
+float thresholdDistance(float percentage);
+void publishThresholds();
+void publishEvents();
+void broadcastRadio(int tenths, bool withThresholds);
+void radioSend(void *frame, size_t size);
+void stampFrame(void *frame, size_t size, uint32_t &seq);
+void sendBeacon(int tenths);
+void onRadioFrame(void *context, const uint8_t *from, const uint8_t *data, size_t len);
+void radioTask();
+void stationTask();
+void powerTask();
+void maybeLightSleep(uint32_t idleUs);
+void displayTask();
+void persistTask();
+void statsTask();
 void setupWiFiServer();
+bool admitRequest(AsyncWebServerRequest *request, RateClass rateClass);
+uint32_t uintParam(AsyncWebServerRequest *request, const char *name);
+bool admitBody(AsyncWebServerRequest *request, size_t len, size_t index, size_t total);
+void sendGzipAsset(AsyncWebServerRequest *request, const char *contentType, const uint8_t *data, size_t len, const char *cacheControl, const char *etag);
+uint32_t postCommand(CommandType type, const char *deviceId, int value);
+Command makeCommand(CommandType type, const char *deviceId, int value);
+void applyCommands();
+void publishTelemetry();
 int findDeviceBlock(String deviceId);
+uint32_t devicePollSlot(const DeviceTable &table, const String &deviceId);
+void addPollSchedule(JsonDocument &doc, uint32_t slot, uint32_t intervalMs);
 void storePercentageByDeviceId(String deviceId, int voltage);
 int retrievePercentageByDeviceId(String deviceId);
 String readDeviceIdFromEEPROM(int address);
@@ -46,26 +301,41 @@ void writeDeviceIdToEEPROM(int address, String deviceId);
 int readPercentageFromEEPROM(int address);
 void writePercentageToEEPROM(int address, int voltage);
 bool deleteDeviceFromEEPROM(String deviceId);
+#ifdef WIRE_BENCHMARK
+void runWireBenchmark();
+#endif
 
 void setup() {
   Serial.begin(115200);
   EEPROM.begin(512);
-  lcd.init();
-  lcd.backlight();
+  lcd.begin(LCD_I2C_HZ, SERVICE_CORE, LCD_PRIORITY);
   // Pin configuration for buttons
-  pinMode(MENU_PIN, INPUT_PULLUP);
-  pinMode(UP_PIN, INPUT_PULLUP);
-  pinMode(DOWN_PIN, INPUT_PULLUP);
+  setupButtons();
 
   // Setup WiFi AP
-  WiFi.softAP("ESP32_Battery_Monitor");
+  WiFi.softAP("ESP32_Battery_Monitor", NULL, SOFTAP_CHANNEL, 0, SOFTAP_MAX_STATIONS);
   WiFi.softAPConfig(IPAddress(192, 168, 1, 1), IPAddress(192, 168, 1, 1), IPAddress(255, 255, 255, 0));
+
+  // The epoch must only ever grow: relay nodes refuse frames from a boot before the latest they saw
+  uint32_t bootCount;
+  EEPROM.get(bootCountAddress, bootCount);
+  radioEpoch = (bootCount == 0xFFFFFFFF ? 0 : bootCount) + 1;  // Erased EEPROM reads 0xFF
+  EEPROM.put(bootCountAddress, radioEpoch);
+  EEPROM.commit();
+  radio.onReceive(onRadioFrame, NULL);
+  if (!radio.begin()) {
+    Serial.println("ESP-NOW unavailable, relay nodes fall back to HTTP");
+  }
 Serial.println("IP Address: welcome to the server v");
 
   analogReadResolution(12);  // ESP32 ADC is 12-bit
 
   setupWiFiServer();  // Start WiFi server
 
+#ifdef WIRE_BENCHMARK
+  runWireBenchmark();
+#endif
+
   // Read percentage, setPercentageForOff, and systemType from EEPROM
   percentage = EEPROM.read(percentageAddress);
   percentage = (percentage < 0 || percentage > 100) ? 0 : percentage;  // Ensure valid percentage range
@@ -75,19 +345,546 @@ Serial.println("IP Address: welcome to the server v");
 
   int storedSystemType = EEPROM.read(systemTypeAddress);
   systemType = (storedSystemType == 12 || storedSystemType == 24 || storedSystemType == 48) ? storedSystemType : 0.0;
+
+  lowPowerMode = EEPROM.read(lowPowerAddress) == 1;  // Erased EEPROM reads 0xFF: off
+
+  publishTelemetry();
+  publishThresholds();
+
+  power.cpuMhz = getCpuFrequencyMhz();
+  power.backlight = true;
+  powerAccountedUs = esp_timer_get_time();
+
+  commandJob = scheduler.add("commands", COMMAND_PERIOD_MS, applyCommands);
+  displayJob = scheduler.add("display", DISPLAY_PERIOD_MS, displayTask);
+  scheduler.add("persist", PERSIST_PERIOD_MS, persistTask);
+  scheduler.add("stats", STATS_PERIOD_MS, statsTask);
+  scheduler.add("power", POWER_PERIOD_MS, powerTask);
+  scheduler.add("radio", RADIO_PERIOD_MS, radioTask);
+  scheduler.add("stations", STATION_PERIOD_MS, stationTask);
+
+  sampleQueue = xQueueCreate(SAMPLE_QUEUE_SIZE, sizeof(Sample));
+  xTaskCreatePinnedToCore(serviceTask, "service", SERVICE_STACK_SIZE, NULL, SERVICE_PRIORITY, &serviceHandle, SERVICE_CORE);
+  xTaskCreatePinnedToCore(samplerTask, "sampler", SAMPLER_STACK_SIZE, NULL, SAMPLER_PRIORITY, &samplerHandle, SAMPLER_CORE);
 }
 
 void loop() {
-  float voltage = getVoltage();
-  float batteryType = detectBatteryType(voltage);
-  float batteryPercentage = calculateBatteryPercentage(voltage, batteryType);
+  // All work happens in the sampler and service tasks created by setup().
+  vTaskDelete(NULL);
+}
+
+/**
+ * The function `samplerTask` reads the battery and hands the reading and its estimates to the service
+ * task. The time until the next reading comes from `samplingRate`. It never touches shared state other
+ * than through seqlocks and queues, so nothing on the other core can hold it up.
+ */
+void samplerTask(void *arg) {
+  uint32_t startedMs = millis();
+  uint32_t dueMs = startedMs;
+  SamplingReport report = {};
+
+  for (;;) {
+    // Deadlines are kept in millis() rather than ticks, since the tick count stands still during light
+    // sleep. maybeLightSleep() notifies this task on wake-up so it can recheck.
+    int32_t waitMs = (int32_t)(dueMs - millis());
+    if (waitMs > 0) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+      continue;
+    }
+
+    uint32_t startUs = micros();
+    Sample sample;
+    sample.voltage = getVoltage();
+    sample.systemType = detectBatteryType(sample.voltage);
+    sample.percentage = calculateBatteryPercentage(sample.voltage, sample.systemType);
+    sample.sampledAtMs = millis();
+    if (xQueueSend(sampleQueue, &sample, 0) != pdTRUE) {
+      samplesDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t periodMs = samplingRate.update(sample.voltage, sample.sampledAtMs, thresholdDistance(sample.percentage));
+    report.periodMs = periodMs;
+    report.slopePerMinute = samplingRate.slopePerMinute();
+    report.rateChanges = samplingRate.rateChanges();
+    report.samples++;
+    report.fixedRateSamples = (sample.sampledAtMs - startedMs) / SAMPLE_MIN_PERIOD_MS + 1;
+    samplingReport.write(report);
+    samplerBusy.add(micros() - startUs);
+
+    dueMs = sample.sampledAtMs + periodMs;
+    nextSampleMs.store(dueMs, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * The function `thresholdDistance` finds how far the charge is from the nearest switch-off threshold.
+ *
+ * @return The distance in percentage points, or -1 when no threshold is set.
+ */
+float thresholdDistance(float percentage) {
+  ThresholdSet set = thresholds.read();
+  float nearest = -1;
+  for (uint32_t i = 0; i < set.count; i++) {
+    float distance = fabsf(percentage - set.values[i]);
+    if (nearest < 0 || distance < nearest) {
+      nearest = distance;
+    }
+  }
+  return nearest;
+}
+
+/**
+ * The function `publishThresholds` collects the thresholds of all registered devices and the monitor's
+ * own `setPercentageForOff` for the sampling task and the HTTP handlers, and lays out the radio frames
+ * that announce them to the relay nodes. It reads the EEPROM, so it is only called when one of them
+ * may have changed.
+ */
+void publishThresholds() {
+  ThresholdSet set;
+  set.count = 0;
+  set.values[set.count++] = setPercentageForOff;
+  publishedPercentageForOff = setPercentageForOff;
+  DeviceTable table;
+  memset(&table, 0, sizeof(table));
+  thresholdGeneration++;
+
+  WireRadioThreshold entries[MAX_DEVICES];
+  uint8_t total = 0;
+  for (int i = 0; i < MAX_DEVICES && set.count < THRESHOLD_SET_SIZE; i++) {
+    int address = i * DEVICE_BLOCK_SIZE;
+    String deviceId = readDeviceIdFromEEPROM(address);
+    if (deviceId != "") {
+      int threshold = readPercentageFromEEPROM(address + DEVICE_ID_SIZE);
+      threshold = threshold < 0 ? 0 : (threshold > 100 ? 100 : threshold);
+      set.values[set.count++] = threshold;
+      DeviceEntry &device = table.devices[table.count++];
+      strncpy(device.deviceId, deviceId.c_str(), sizeof(device.deviceId));
+      device.threshold = threshold;
+      device.block = i;
+      strncpy(entries[total].deviceId, deviceId.c_str(), WIRE_DEVICE_ID_SIZE);
+      entries[total].threshold = threshold;
+      total++;
+    }
+  }
+  thresholds.write(set);
+  deviceTable.write(table);
+
+  uint8_t defaultThreshold = setPercentageForOff;
+  thresholdTableHash = wireFnv1a(WIRE_FNV_OFFSET, entries, total * sizeof(WireRadioThreshold));
+  thresholdTableHash = wireFnv1a(thresholdTableHash, &defaultThreshold, sizeof(defaultThreshold));
+
+  // Devices missing from the pages get `defaultThreshold`, as /getVoltageById answers for them
+  radioThresholdPages = 0;
+  for (uint8_t first = 0; first < total || radioThresholdPages == 0; first += WIRE_RADIO_THRESHOLDS_MAX) {
+    WireRadioThresholdsFrame &page = radioThresholds[radioThresholdPages++];
+    memset(&page, 0, sizeof(page));
+    wireInitHeader(page.header, WIRE_FRAME_RADIO_THRESHOLDS, sizeof(page));
+    page.generation = thresholdGeneration;
+    page.defaultThreshold = setPercentageForOff;
+    page.first = first;
+    page.total = total;
+    page.count = min(total - first, WIRE_RADIO_THRESHOLDS_MAX);
+    memcpy(page.entries, entries + first, page.count * sizeof(WireRadioThreshold));
+  }
+  publishEvents();
+}
+
+/**
+ * The function `publishEvents` pushes a `telemetry` event to the `/events` subscribers and broadcasts it
+ * on the radio when the percentage moved by a tenth of a point or a threshold may have changed, and at
+ * least every `EVENT_HEARTBEAT_MS` so subscribers can tell a quiet battery from a dead connection.
+ *
+ * The event data is `{"percentage":63.5,"systemType":24,"gen":7}`. A subscriber refetches its own
+ * threshold from `/getVoltageById` whenever `gen` changes.
+ */
+void publishEvents() {
+  static int lastTenths = -1;
+  static uint32_t lastGeneration = 0;
+  static uint32_t lastEventMs = 0;
+  static uint32_t eventId = 0;
+
+  uint32_t now = millis();
+  int tenths = (int)lroundf(percentage * 10);
+  bool heartbeat = now - lastEventMs >= EVENT_HEARTBEAT_MS;
+  bool thresholdsChanged = thresholdGeneration != lastGeneration;
+  if (tenths == lastTenths && !thresholdsChanged && !heartbeat) {
+    return;
+  }
+  lastTenths = tenths;
+  lastGeneration = thresholdGeneration;
+  lastEventMs = now;
+  broadcastRadio(tenths, thresholdsChanged || heartbeat);  // Repeated on heartbeats for nodes that just joined
+  if (events.count() == 0) {
+    return;
+  }
+
+  char data[64];
+  snprintf(data, sizeof(data), "{\"percentage\":%.1f,\"systemType\":%d,\"gen\":%u}", tenths / 10.0, (int)systemType, (unsigned)thresholdGeneration);
+  events.send(data, "telemetry", ++eventId);
+}
+
+/**
+ * The function `broadcastRadio` sends the threshold pages, if asked to, followed by a telemetry frame.
+ * The pages go first, so a node that sees a new `generation` in the telemetry frame already has them.
+ */
+void broadcastRadio(int tenths, bool withThresholds) {
+  if (withThresholds) {
+    for (uint32_t i = 0; i < radioThresholdPages; i++) {
+      radioSend(&radioThresholds[i], sizeof(radioThresholds[i]));
+    }
+  }
+
+  WireRadioTelemetryFrame frame;
+  wireInitHeader(frame.header, WIRE_FRAME_RADIO_TELEMETRY, sizeof(frame));
+  frame.generation = thresholdGeneration;
+  frame.percentageCenti = (uint16_t)(tenths * 10);
+  frame.systemType = (uint8_t)systemType;
+  radioSend(&frame, sizeof(frame));
+  radioTelemetrySeq = radioSeq;
+  radioRecentTelemetry[radioRecentCount++ % RADIO_ACK_WINDOW] = radioSeq;
+  radioSentUs = esp_timer_get_time();
+  sendBeacon(tenths);
+}
+
+// Multicasts the beacon; one packet however many relay nodes listen.
+void sendBeacon(int tenths) {
+  if (WiFi.softAPgetStationNum() == 0) {
+    return;
+  }
+  WireBeaconFrame frame;
+  wireInitHeader(frame.header, WIRE_FRAME_BEACON, sizeof(frame));
+  frame.tableHash = thresholdTableHash;
+  frame.percentageCenti = (uint16_t)(tenths * 10);
+  frame.systemType = (uint8_t)systemType;
+  stampFrame(&frame, sizeof(frame), beaconSeq);
+  if (beaconUdp.beginPacket(IPAddress(WIRE_BEACON_GROUP), WIRE_BEACON_PORT)) {
+    beaconUdp.write((const uint8_t *)&frame, sizeof(frame));
+    if (beaconUdp.endPacket()) {
+      beaconsSent.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * The function `stampFrame` gives a radio or beacon frame the next number of sequence `seq` and signs
+ * it. Every such frame starts with the header, epoch and seq, in that order.
+ */
+void stampFrame(void *frame, size_t size, uint32_t &seq) {
+  uint32_t stamp[2] = {radioEpoch, ++seq};
+  memcpy((uint8_t *)frame + sizeof(WireHeader), stamp, sizeof(stamp));  // Packed frames may be unaligned
+  wireSign(frame, size, radioKey);
+}
+
+// Stamps a radio frame and broadcasts it.
+void radioSend(void *frame, size_t size) {
+  stampFrame(frame, size, radioSeq);
+  if (radio.send(NULL, (const uint8_t *)frame, size)) {
+    radioState.framesSent++;
+  } else {
+    radioState.sendFailures++;
+  }
+}
+
+/**
+ * The function `onRadioFrame` is called by the ESP-NOW driver for every frame received. It runs on the
+ * WiFi task, so it only checks the frame and queues acknowledgements for `radioTask`.
+ */
+void onRadioFrame(void *context, const uint8_t *from, const uint8_t *data, size_t len) {
+  WireRadioRelayStateFrame frame;
+  if (!wireDecode(data, len, WIRE_FRAME_RADIO_RELAY_STATE, &frame, sizeof(frame)) ||
+      !wireVerify(&frame, sizeof(frame), radioKey) || frame.epoch != radioEpoch) {
+    radioBadFrames.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  RadioAck ack;
+  memcpy(ack.address, from, TRANSPORT_ADDRESS_SIZE);
+  ack.seq = frame.seq;
+  ack.channels = frame.channels;
+  ack.loadOnMask = frame.loadOnMask;
+  ack.switches = frame.switches;
+  ack.receivedUs = esp_timer_get_time();
+  if (!radioAcks.push(ack)) {
+    radioAcksDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * The function `radioTask` takes the relay nodes' acknowledgements into the node table and publishes
+ * it for `/radio`. Only acknowledgements of one of the last telemetry frames sent are taken, each at
+ * most once per node, so a recorded one cannot be played back to fake relay states. A node that
+ * acknowledges the latest telemetry frame gets its round trip measured.
+ */
+void radioTask() {
+  RadioAck ack;
+  while (radioAcks.pop(ack)) {
+    radioState.acksReceived++;
+    bool recent = false;
+    for (uint32_t i = 0; i < RADIO_ACK_WINDOW; i++) {
+      recent = recent || (ack.seq != 0 && ack.seq == radioRecentTelemetry[i]);
+    }
+    RadioNode *node = NULL;
+    for (uint32_t i = 0; i < radioState.count; i++) {
+      if (memcmp(radioState.nodes[i].address, ack.address, TRANSPORT_ADDRESS_SIZE) == 0) {
+        node = &radioState.nodes[i];
+        break;
+      }
+    }
+    if (!recent || (node != NULL && (int32_t)(ack.seq - node->lastSeq) <= 0)) {
+      radioState.acksReplayed++;
+      continue;
+    }
+    if (node == NULL) {
+      if (radioState.count == RADIO_MAX_NODES) {
+        continue;
+      }
+      node = &radioState.nodes[radioState.count++];
+      memset(node, 0, sizeof(*node));
+      memcpy(node->address, ack.address, TRANSPORT_ADDRESS_SIZE);
+    }
+    node->acks++;
+    node->lastSeq = ack.seq;
+    node->lastAckMs = millis();
+    node->roundTripUs = ack.seq == radioTelemetrySeq ? (uint32_t)(ack.receivedUs - radioSentUs) : 0;
+    if (node->roundTripUs > node->maxRoundTripUs) {
+      node->maxRoundTripUs = node->roundTripUs;
+    }
+    node->channels = ack.channels;
+    node->loadOnMask = ack.loadOnMask;
+    node->switches = ack.switches;
+    stations.touchMac(ack.address, node->lastAckMs);  // ESP-NOW goes out from the node's station address
+  }
+  radioState.badFrames = radioBadFrames.load(std::memory_order_relaxed);
+  radioState.acksDropped = radioAcksDropped.load(std::memory_order_relaxed);
+  radioReport.write(radioState);
+}
+
+/**
+ * The function `stationTask` rebuilds the station table from the WiFi driver's list, with the
+ * addresses DHCP handed out, and takes in when each address was last seen. When the softAP is close to
+ * its limit it deauthenticates at most one idle station per run. The evicted node reconnects on its own
+ * backoff.
+ */
+void stationTask() {
+  StationListing listed[STATION_TABLE_SIZE];
+  uint32_t listedCount = 0;
+  wifi_sta_list_t wifiList;
+  esp_netif_sta_list_t ipList;
+  if (esp_wifi_ap_get_sta_list(&wifiList) != ESP_OK || esp_netif_get_sta_list(&wifiList, &ipList) != ESP_OK) {
+    return;  // Keeps the last table rather than emptying it
+  }
+  for (int i = 0; i < ipList.num && listedCount < STATION_TABLE_SIZE; i++) {
+    memcpy(listed[listedCount].mac, ipList.sta[i].mac, sizeof(listed[listedCount].mac));
+    listed[listedCount].ip = ipList.sta[i].ip.addr;
+    listedCount++;
+  }
+
+  uint32_t now = millis();
+  stations.sync(listed, listedCount, now);
+  for (uint32_t i = 0; i < stations.size(); i++) {
+    uint32_t ip = stations.entry(i).ip;
+    uint32_t seenMs = ip != 0 ? stationSeenMs[IPAddress(ip)[3]].load(std::memory_order_relaxed) : 0;
+    if (seenMs != 0) {
+      stations.touch(i, seenMs);
+    }
+  }
+
+  // The association ID is looked up at the last moment, so it cannot belong to someone else by now.
+  int idle = stations.pickEviction(now);
+  uint16_t aid;
+  if (idle >= 0 && esp_wifi_ap_get_sta_aid(stations.entry(idle).mac, &aid) == ESP_OK && aid != 0 &&
+      esp_wifi_deauth_sta(aid) == ESP_OK) {
+    stations.evicted(idle, now);
+  }
+
+  stationReport.write(stations.report());
+}
+
+/**
+ * The function `serviceTask` runs the scheduled jobs and takes samples off `sampleQueue` as they
+ * arrive. It is the only task that writes the working state, the EEPROM or `telemetry`.
+ */
+void serviceTask(void *arg) {
+  for (;;) {
+    uint32_t startUs = micros();
+    uint32_t idleUs = scheduler.tick();
+    serviceBusy.add(micros() - startUs);
+
+    if (lowPowerMode) {
+      maybeLightSleep(idleUs);
+      idleUs = scheduler.tick();
+    }
+
+    // Wait for the next sample, but no longer than until the next job is due.
+    Sample sample;
+    if (xQueueReceive(sampleQueue, &sample, pdMS_TO_TICKS(idleUs / 1000)) == pdTRUE) {
+      startUs = micros();
+      applySample(sample);
+      serviceBusy.add(micros() - startUs);
+    }
+  }
+}
+
+/**
+ * The function `applySample` takes a reading from the sampler into the working state, updates the
+ * voltage aggregates and publishes the result for the HTTP handlers.
+ */
+void applySample(const Sample &sample) {
+  lastVoltage = sample.voltage;
+  if (sample.systemType != 0) {
+    systemType = sample.systemType;  // Saved to EEPROM by persistTask()
+  }
+  percentage = sample.percentage;
+  sampleCount++;
+  lastSampleMs = sample.sampledAtMs;
+  for (int i = 0; i < TELEMETRY_WINDOW_COUNT; i++) {
+    voltageWindows[i].add(sample.voltage, lastSampleMs);
+  }
+  publishTelemetry();
+  publishEvents();
+}
+
+/**
+ * The function `displayTask` draws whichever screen is active: a pending mode change message, the
+ * set mode screen, or the normal readings.
+ */
+void displayTask() {
+  if (lcd.takeOverflow()) {
+    lcdRenderer.invalidate();
+  }
+
+  if ((int32_t)(messageUntilMs - millis()) > 0) {
+    lcdRenderer.render(messageFrame);
+  } else if (inVoltageSettingMode) {
+    LcdFrame frame;
+    frame.print(0, 0, "Set Percentage: ");
+    frame.printf(0, 1, "%d%%", setPercentageForOff);
+    lcdRenderer.render(frame);
+  } else {
+    displayOnLCD(lastVoltage, percentage);
+  }
+}
+
+/**
+ * The function `persistTask` saves the system type, last percentage and switch-off threshold. Doing it
+ * here instead of on every sample keeps flash writes down to one commit per period at most, and none
+ * when nothing changed.
+ */
+void persistTask() {
+  EEPROM.write(systemTypeAddress, (int)systemType);
+  EEPROM.write(percentageAddress, (int)percentage);
+  EEPROM.write(setPercentageOffAddress, setPercentageForOff);
+  EEPROM.commit();
+}
+
+/**
+ * The function `powerTask` books the time since its last run against the current power state, then
+ * applies the power policy: CPU clock, backlight, and how often the display and command queue are
+ * looked at.
+ */
+void powerTask() {
+  uint32_t now = millis();
+  int64_t nowUs = esp_timer_get_time();
+  uint64_t elapsedUs = nowUs - powerAccountedUs;
+  uint64_t sleptUs = power.sleepUs - sleepAccountedUs;
+  uint64_t awakeUs = elapsedUs > sleptUs ? elapsedUs - sleptUs : 0;
+  if (power.cpuMhz >= CPU_FAST_MHZ) {
+    power.fastUs += awakeUs;
+  } else {
+    power.slowUs += awakeUs;
+  }
+  if (power.backlight) {
+    power.backlightUs += elapsedUs;
+  }
+  powerAccountedUs = nowUs;
+  sleepAccountedUs = power.sleepUs;
+
+  bool boost = !lowPowerMode || powerPolicy.boost(now, lastRequestMs.load(std::memory_order_relaxed));
+  bool backlight = !lowPowerMode || powerPolicy.backlightOn(now);
+  uint32_t mhz = boost ? CPU_FAST_MHZ : CPU_SLOW_MHZ;
+
+  if (backlight != power.backlight) {
+    lcd.setBacklight(backlight);
+    power.backlight = backlight;
+  }
+  if (mhz != power.cpuMhz) {
+    setCpuFrequencyMhz(mhz);
+    power.cpuMhz = mhz;
+    scheduler.setPeriod(commandJob, boost ? COMMAND_PERIOD_MS : COMMAND_SLOW_PERIOD_MS);
+    scheduler.setPeriod(displayJob, boost ? DISPLAY_PERIOD_MS : DISPLAY_SLOW_PERIOD_MS);
+  }
+  power.lowPower = lowPowerMode;
+  powerReport.write(power);
+}
+
+/**
+ * The function `maybeLightSleep` puts the chip into light sleep until the next scheduled job or sample
+ * when the power policy allows it and nothing is in flight. The buttons and the timer wake it up.
+ *
+ * The soft AP does not beacon while asleep, so the policy never sleeps with a station associated, and
+ * keeps sleeps short with awake gaps in between so a phone looking for the network still finds it.
+ * Modem sleep is not an option here: ESP-IDF only supports it in station mode.
+ */
+void maybeLightSleep(uint32_t idleUs) {
+  uint32_t now = millis();
+  int32_t untilSampleMs = (int32_t)(nextSampleMs.load(std::memory_order_relaxed) - now);
+  uint32_t idleMs = idleUs / 1000;
+  if (untilSampleMs < (int32_t)idleMs) {
+    idleMs = untilSampleMs > 0 ? untilSampleMs : 0;
+  }
+
+  uint32_t sleepMs = powerPolicy.sleepBudget(now, lastRequestMs.load(std::memory_order_relaxed), WiFi.softAPgetStationNum(), idleMs);
+  if (sleepMs == 0 || !lcd.idle() || uxQueueMessagesWaiting(sampleQueue) > 0) {
+    return;
+  }
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    if (xTimerIsTimerActive(buttonTimers[i]) != pdFALSE) {
+      return;  // A press is being debounced or a button is held
+    }
+  }
 
-  // Display the voltage and battery percentage on the LCD
-  displayOnLCD(voltage, batteryPercentage);
+  // Buttons wake the chip on a low level. Their edge interrupts are off meanwhile, since the wake-up
+  // setting replaces the pins' interrupt type.
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    gpio_intr_disable((gpio_num_t)buttonPins[i]);
+    gpio_wakeup_enable((gpio_num_t)buttonPins[i], GPIO_INTR_LOW_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+
+  int64_t startUs = esp_timer_get_time();
+  esp_light_sleep_start();
+  power.sleepUs += esp_timer_get_time() - startUs;
+  power.sleeps++;
+
+  bool buttonWake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+  for (int i = 0; i < BUTTON_COUNT; i++) {
+    gpio_wakeup_disable((gpio_num_t)buttonPins[i]);
+    gpio_set_intr_type((gpio_num_t)buttonPins[i], GPIO_INTR_ANYEDGE);
+    gpio_intr_enable((gpio_num_t)buttonPins[i]);
+    if (buttonWake) {
+      // The press happened while asleep, so no edge was seen; let the state machines read the pins.
+      xTimerChangePeriod(buttonTimers[i], pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), 0);
+    }
+  }
+  powerPolicy.woke(millis());
+  xTaskNotifyGive(samplerHandle);
+}
 
-  // Handle button presses to adjust setPercentageForOff
-  buttonToSetPercentageOff();
-  delay(1000);
+/**
+ * The function `statsTask` publishes the scheduler's timing counters and each task's CPU share and
+ * stack headroom for /tasks.
+ */
+void statsTask() {
+  schedulerReport.write(scheduler.report());
+
+  uint32_t nowUs = micros();
+  ThreadReport report;
+  report.count = 2;
+  report.samplesDropped = samplesDropped.load(std::memory_order_relaxed);
+  report.threads[0] = ThreadStats{"sampler", SAMPLER_CORE, SAMPLER_PRIORITY, samplerBusy.sample(nowUs), uxTaskGetStackHighWaterMark(samplerHandle)};
+  report.threads[1] = ThreadStats{"service", SERVICE_CORE, SERVICE_PRIORITY, serviceBusy.sample(nowUs), uxTaskGetStackHighWaterMark(serviceHandle)};
+  threadReport.write(report);
 }
 
 float getVoltage() {
@@ -102,19 +899,10 @@ float getVoltage() {
 
 float detectBatteryType(float voltage) {
   if (voltage <= 14.4) {
-    EEPROM.write(systemTypeAddress, 12);
-    systemType = 12.0;
-    EEPROM.commit();
     return 12.0;
   } else if (voltage <= 28.8) {
-    EEPROM.write(systemTypeAddress, 24);
-    systemType = 24.0;
-    EEPROM.commit();
     return 24.0;
   } else if (voltage <= 57.6) {
-    EEPROM.write(systemTypeAddress, 48);
-    systemType = 48.0;
-    EEPROM.commit();
     return 48.0;
   } else {
     return 0.0;
@@ -141,9 +929,6 @@ float calculateBatteryPercentage(float voltage, float systemType) {
   } else if (voltage >= newMaxVoltage) {
     c = 100;
   }
-  percentage = c;
-  EEPROM.write(percentageAddress, (int)c);
-  EEPROM.commit();
   return c;
 }
 
@@ -164,24 +949,12 @@ void displayOnLCD(float voltage, float percentage) {
   int roundedVoltage = static_cast<int>(ceil(voltage));
 
   if (inVoltageSettingMode == false) {
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("Volt: ");
-    lcd.print(roundedVoltage);
-    lcd.print("V ");
-    lcd.setCursor(9, 0);
-    lcd.print("Sys:");
-    lcd.print(systemType);
-    lcd.print("V");
-    lcd.setCursor(0, 1);
-    lcd.print("Bat:");
-    lcd.print(roundedPercentage);
-    lcd.print("%");
-    lcd.setCursor(9, 1);
-    lcd.print("Off:");
-    lcd.print(setPercentageForOff);
-    lcd.print("%");
-    delay(1000);
+    LcdFrame frame;
+    frame.printf(0, 0, "Volt: %dV ", roundedVoltage);
+    frame.printf(9, 0, "Sys:%.2fV", systemType);
+    frame.printf(0, 1, "Bat:%d%%", roundedPercentage);
+    frame.printf(9, 1, "Off:%d%%", setPercentageForOff);
+    lcdRenderer.render(frame);
   }
 }
 
@@ -196,145 +969,565 @@ void displayOnLCD(float voltage, float percentage) {
  * devices.
  */
 void setupWiFiServer() {
-  
-
-#include <ArduinoJson.h>
+  // Every endpoint answers in JSON, MessagePack or a fixed binary frame depending on the `Accept`
+  // header, see wire_format.h.
 
-// In the setupWiFiServer() function:
 server.on("/setPercentageOffs", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (!admitBody(request, len, index, total)) {
+        return;
+    }
+
     // Create a JSON document object to store incoming data
     JsonDocument jsonDoc;
-    DeserializationError error = deserializeJson(jsonDoc, (const char*)data);
+    DeserializationError error = parseRequestBody(request, data, len, jsonDoc);
     if (error) {
-        request->send(400, "application/json", "{\"error\":\"Invalid JSON format\"}");
+        sendError(request, 400, "Invalid JSON format");
         return;
     }
 
-   
+    // One command per device, queued all together or not at all. They are applied in order, so once
+    // the last one is acknowledged the whole batch is stored.
+    JsonObject percentages = jsonDoc.as<JsonObject>();
+    if (percentages.size() > COMMAND_QUEUE_SIZE) {
+        sendError(request, 400, "Too many devices");
+        return;
+    }
+    Command batch[COMMAND_QUEUE_SIZE];
+    size_t count = 0;
+    for (JsonPair kv : percentages) {
+      batch[count++] = makeCommand(COMMAND_SET_DEVICE_PERCENTAGE, kv.key().c_str(), kv.value().as<int>());
+    }
+    if (!commandQueue.pushAll(batch, count)) {
+        sendError(request, 503, "Command queue full");
+        return;
+    }
 
+    sendAccepted(request, count > 0 ? batch[count - 1].seq : 0, "Percentages queued");
+});
 
-    
-    // Iterate over each key-value pair in the JSON document
-    for (JsonPair kv : jsonDoc.as<JsonObject>()) {
-      String deviceId = kv.key().c_str();
-      int voltage = kv.value().as<int>();
+server.on("/getVoltageById", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
+    pollArrivals.record(millis());
+
+    if (request->hasParam("deviceId")) {
+        String deviceId = request->getParam("deviceId")->value();
+        Telemetry snapshot = telemetry.read();
+        DeviceTable table = deviceTable.read();
+        const DeviceEntry *device = findDevice(table, deviceId.c_str());
+        int voltage = device != NULL ? device->threshold : snapshot.setPercentageForOff;
+
+        WireFormat format = negotiateWireFormat(request);
+        if (format == WIRE_FORMAT_BINARY) {
+            WireDeviceTelemetryFrame frame;
+            wireInitHeader(frame.header, WIRE_FRAME_DEVICE_TELEMETRY, sizeof(frame));
+            strncpy(frame.deviceId, deviceId.c_str(), sizeof(frame.deviceId));
+            frame.threshold = voltage;
+            frame.systemType = (uint8_t)snapshot.systemType;
+            frame.percentageCenti = (uint16_t)(snapshot.percentage * 100);
+            sendFrame(request, 200, &frame, sizeof(frame));
+            return;
+        }
 
-      // Store voltage for that device dynamically
-      storePercentageByDeviceId(deviceId, voltage);
+        JsonDocument jsonResponse;
+        jsonResponse["deviceId"] = deviceId;
+        jsonResponse["voltage"] = voltage;
+        jsonResponse["systemType"] = snapshot.systemType;
+        jsonResponse["percentage"] = snapshot.percentage;
+        addPollSchedule(jsonResponse, devicePollSlot(table, deviceId), pollIntervalMs(pollSchedule, snapshot.percentage, voltage));
+        sendDocument(request, 200, jsonResponse, format);
+    } else {
+        sendError(request, 400, "Missing deviceId parameter");
     }
- EEPROM.commit(); 
-    // Create a JSON response
-   
+});
 
+// Thresholds of several devices plus the battery percentage in one reply, for relay nodes that drive a
+// circuit per device: `deviceIds=a,b,c`. Devices without a stored threshold get the default one.
+server.on("/getVoltageByIds", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
+    pollArrivals.record(millis());
+    if (!request->hasParam("deviceIds")) {
+        sendError(request, 400, "Missing deviceIds parameter");
+        return;
+    }
 
+    String deviceIds = request->getParam("deviceIds")->value();
+    Telemetry snapshot = telemetry.read();
+    DeviceTable table = deviceTable.read();
+    JsonDocument jsonResponse;
+    jsonResponse["systemType"] = snapshot.systemType;
+    jsonResponse["percentage"] = snapshot.percentage;
+    JsonArray devices = jsonResponse["devices"].to<JsonArray>();
+
+    // One schedule for the node: the shortest interval of its devices, in the slot of the first one
+    int start = 0;
+    int count = 0;
+    String nodeId;
+    uint32_t slot = 0;
+    uint32_t intervalMs = POLL_MAX_INTERVAL_MS;
+    while (start <= (int)deviceIds.length()) {
+        int end = deviceIds.indexOf(',', start);
+        if (end < 0) {
+            end = deviceIds.length();
+        }
+        String deviceId = deviceIds.substring(start, end);
+        start = end + 1;
+        if (deviceId.length() == 0) {
+            continue;
+        }
+        if (++count > MAX_BATCH_DEVICE_IDS) {
+            sendError(request, 400, "Too many deviceIds");
+            return;
+        }
 
+        const DeviceEntry *device = findDevice(table, deviceId.c_str());
+        int voltage = device != NULL ? device->threshold : snapshot.setPercentageForOff;
+        JsonObject entry = devices.add<JsonObject>();
+        entry["deviceId"] = deviceId;
+        entry["voltage"] = voltage;
 
+        if (count == 1) {
+            nodeId = deviceId;
+            slot = devicePollSlot(table, deviceId);
+        }
+        intervalMs = min(intervalMs, pollIntervalMs(pollSchedule, snapshot.percentage, voltage));
+    }
+    addPollSchedule(jsonResponse, slot, intervalMs);
+
+    NodeStatus &node = nodeStatus.record(nodeId.c_str(), millis());
+    node.awakeMs = uintParam(request, "awakeMs");
+    node.averageUa = uintParam(request, "uA");
+    node.connects = uintParam(request, "connects");
+    node.reuses = uintParam(request, "reuses");
+    node.parseHeap = uintParam(request, "parseHeap");
+    node.beacons = uintParam(request, "beacons");
+    node.radioFrames = uintParam(request, "radioFrames");
+    node.radioRejected = uintParam(request, "radioRejected");
+
+    // There is no binary frame for a list; binary requests get JSON back.
+    sendDocument(request, 200, jsonResponse, negotiateWireFormat(request));
+});
 
+// Current reading plus min/max/mean/stddev of the voltage over the last 1 min, 15 min and 1 h. Pass
+// `window=1m|15m|1h` to get a single window.
+server.on("/getvoltage", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
 
+    Telemetry snapshot = telemetry.read();
+    if (snapshot.sampleCount == 0) {
+        sendError(request, 500, "Failed to read voltage");
+        return;
+    }
+
+    int selectedWindow = -1;  // All of them
+    if (request->hasParam("window")) {
+        const String &name = request->getParam("window")->value();
+        for (int i = 0; i < TELEMETRY_WINDOW_COUNT; i++) {
+            if (name == voltageWindowNames[i]) {
+                selectedWindow = i;
+            }
+        }
+        if (selectedWindow == -1) {
+            sendError(request, 400, "Unknown window");
+            return;
+        }
+    }
+
+    WireFormat format = negotiateWireFormat(request);
+    if (format == WIRE_FORMAT_BINARY) {
+        WireMonitorTelemetryFrame frame;
+        wireInitHeader(frame.header, WIRE_FRAME_MONITOR_TELEMETRY, sizeof(frame));
+        frame.voltageCenti = (uint16_t)(snapshot.voltage * 100);
+        frame.percentageCenti = (uint16_t)(snapshot.percentage * 100);
+        frame.systemType = (uint8_t)snapshot.systemType;
+        frame.setPercentageForOff = (uint8_t)snapshot.setPercentageForOff;
+        sendFrame(request, 200, &frame, sizeof(frame));
+        return;
+    }
+
+    int roundedPercentage = static_cast<int>(ceil(snapshot.percentage));
+    int roundedVoltage = static_cast<int>(ceil(snapshot.voltage));
 
-    // Create a JSON response
     JsonDocument responseDoc;
-    responseDoc["status"] = "success";
+    responseDoc["voltage"] = roundedVoltage;
+    responseDoc["percentage"] = roundedPercentage;
+    responseDoc["systemType"] = snapshot.systemType;
+    responseDoc["setPercentageForOff"] = snapshot.setPercentageForOff;
+    responseDoc["current"] = snapshot.voltage;
+
+    JsonObject windows = responseDoc["windows"].to<JsonObject>();
+    for (int i = 0; i < TELEMETRY_WINDOW_COUNT; i++) {
+        if (selectedWindow != -1 && selectedWindow != i) {
+            continue;
+        }
+        const StatsSummary &stats = snapshot.voltageWindows[i];
+        JsonObject window = windows[voltageWindowNames[i]].to<JsonObject>();
+        window["min"] = stats.min;
+        window["max"] = stats.max;
+        window["mean"] = stats.mean;
+        window["stddev"] = stats.stddev;
+        window["samples"] = stats.count;
+    }
+    sendDocument(request, 200, responseDoc, format);
+});
 
-    String jsonResponse;
-    serializeJson(responseDoc, jsonResponse);
-    request->send(200, "application/json", jsonResponse);
+server.on("/setdefaultoff", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (!admitBody(request, len, index, total)) {
+        return;
+    }
+
+    JsonDocument jsonDoc;
+    DeserializationError error = parseRequestBody(request, data, len, jsonDoc);
+    if (error) {
+        sendError(request, 400, "Invalid JSON format");
+        return;
+    }
+
+    uint32_t seq = postCommand(COMMAND_SET_DEFAULT_OFF, NULL, jsonDoc["percentage"].as<int>());
+    if (seq == 0) {
+        sendError(request, 503, "Command queue full");
+        return;
+    }
+
+    sendAccepted(request, seq, "Percentage update queued");
 });
+server.on("/deleteDevice", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (!admitBody(request, len, index, total)) {
+        return;
+    }
 
-server.on("/getVoltageById", HTTP_GET, [](AsyncWebServerRequest *request) {
-    if (request->hasParam("deviceId")) {
-        String deviceId = request->getParam("deviceId")->value();
-        int voltage = retrievePercentageByDeviceId(deviceId);
+    JsonDocument jsonDoc;
+    DeserializationError error = parseRequestBody(request, data, len, jsonDoc);
+    if (error) {
+        sendError(request, 400, "Invalid JSON format");
+        return;
+    }
 
-        if (voltage == -1) {
-            voltage = setPercentageForOff;
-        }
+    const char *deviceId = jsonDoc["deviceId"];
+    if (deviceId == NULL || deviceId[0] == 0) {
+        sendError(request, 400, "Missing deviceId");
+        return;
+    }
 
-        // Send response in JSON format
-        JsonDocument jsonResponse;
-        jsonResponse["deviceId"] = deviceId;
-        jsonResponse["voltage"] = voltage;
-        jsonResponse["systemType"] = systemType;
-        jsonResponse["percentage"] = percentage;
+    // Whether the device existed is only known once the command runs; see /commandStatus.
+    uint32_t seq = postCommand(COMMAND_DELETE_DEVICE, deviceId, 0);
+    if (seq == 0) {
+        sendError(request, 503, "Command queue full");
+        return;
+    }
 
-        String response;
-        serializeJson(jsonResponse, response);
-        request->send(200, "application/json", response);
-    } else {
-        request->send(400, "application/json", "{\"error\":\"Missing deviceId parameter\"}");
+    sendAccepted(request, seq, "Device deletion queued");
+});
+
+server.on("/commandStatus", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
     }
+
+    if (!request->hasParam("seq")) {
+        sendError(request, 400, "Missing seq parameter");
+        return;
+    }
+
+    uint32_t seq = request->getParam("seq")->value().toInt();
+    if (!commandAcks.isIssued(seq)) {
+        sendError(request, 404, "Unknown command");
+        return;
+    }
+
+    static const char *const names[] = {"pending", "applied", "not_found", "expired"};
+    JsonDocument responseDoc;
+    responseDoc["seq"] = seq;
+    responseDoc["status"] = names[commandAcks.lookup(seq)];
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
 });
 
+server.on("/clientStats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
 
+    static const char *const classNames[RATE_CLASS_COUNT] = {"read", "write"};
+    JsonDocument responseDoc;
+    JsonArray clients = responseDoc["clients"].to<JsonArray>();
+    for (size_t i = 0; i < rateLimiter.size(); i++) {
+        const RateLimitClient &client = rateLimiter.client(i);
+        JsonObject entry = clients.add<JsonObject>();
+        entry["ip"] = IPAddress(client.ip).toString();
+        entry["idleMs"] = millis() - client.lastSeenMs;
+        for (int c = 0; c < RATE_CLASS_COUNT; c++) {
+            JsonObject counters = entry[classNames[c]].to<JsonObject>();
+            counters["allowed"] = client.allowed[c];
+            counters["limited"] = client.limited[c];
+        }
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
 
-server.on("/getvoltage", HTTP_GET, [](AsyncWebServerRequest *request) {
-     JsonDocument responseDoc;  // Fixed size allocation
-    
-    Serial.print("here in get");
-    float rawVoltage =24.4;
-    if (rawVoltage < 0) {  // Assuming negative voltage indicates error
-        request->send(500, "application/json", "{\"error\":\"Failed to read voltage\"}");
+// Timing of the service task's jobs and CPU use of the firmware's tasks as of the last "stats" run,
+// plus the display's I2C counters.
+server.on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
         return;
     }
 
-    
-    int roundedPercentage = static_cast<int>(ceil(percentage));
-    int roundedVoltage = static_cast<int>(ceil(rawVoltage));
-    
-    responseDoc["voltage"] = roundedVoltage;
-    responseDoc["percentage"] = roundedPercentage;
-    responseDoc["systemType"] = systemType;
-    responseDoc["setPercentageForOff"] = setPercentageForOff;
+    SchedulerReport report = schedulerReport.read();
+    JsonDocument responseDoc;
+    JsonArray tasks = responseDoc["tasks"].to<JsonArray>();
+    for (uint32_t i = 0; i < report.count; i++) {
+        const ScheduledTaskStats &task = report.tasks[i];
+        JsonObject entry = tasks.add<JsonObject>();
+        entry["name"] = task.name;
+        entry["periodMs"] = task.periodMs;
+        entry["runs"] = task.runs;
+        entry["overruns"] = task.overruns;
+        entry["maxLatenessUs"] = task.maxLatenessUs;
+        entry["lastDurationUs"] = task.lastDurationUs;
+        entry["maxDurationUs"] = task.maxDurationUs;
+    }
 
+    ThreadReport threads = threadReport.read();
+    JsonArray threadList = responseDoc["threads"].to<JsonArray>();
+    for (uint32_t i = 0; i < threads.count; i++) {
+        const ThreadStats &thread = threads.threads[i];
+        JsonObject entry = threadList.add<JsonObject>();
+        entry["name"] = thread.name;
+        entry["core"] = thread.core;
+        entry["priority"] = thread.priority;
+        entry["cpuPercent"] = thread.cpuPermille / 10.0;
+        entry["stackFreeBytes"] = thread.stackFreeBytes;
+    }
+    responseDoc["samplesDropped"] = threads.samplesDropped;
+
+    I2cLcdStats bus = lcd.stats();
+    JsonObject lcdBus = responseDoc["lcdBus"].to<JsonObject>();
+    lcdBus["hz"] = bus.busHz;
+    lcdBus["transactions"] = bus.transactions;
+    lcdBus["bytes"] = bus.bytes;
+    lcdBus["nackAddress"] = bus.nackAddress;
+    lcdBus["nackData"] = bus.nackData;
+    lcdBus["timeouts"] = bus.timeouts;
+    lcdBus["otherErrors"] = bus.otherErrors;
+    lcdBus["overflows"] = bus.overflows;
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
 
+// How the adaptive sampling rate has behaved since boot, see AdaptiveRate.
+server.on("/sampling", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
 
-    String response;
-    serializeJson(responseDoc, response);
-    
+    SamplingReport report = samplingReport.read();
+    JsonDocument responseDoc;
+    responseDoc["periodMs"] = report.periodMs;
+    responseDoc["minPeriodMs"] = SAMPLE_MIN_PERIOD_MS;
+    responseDoc["maxPeriodMs"] = SAMPLE_MAX_PERIOD_MS;
+    responseDoc["slopeVoltsPerMinute"] = report.slopePerMinute;
+    responseDoc["rateChanges"] = report.rateChanges;
+    responseDoc["samples"] = report.samples;
+    responseDoc["fixedRateSamples"] = report.fixedRateSamples;
+    // Share of the samples, and so of the sampler's CPU time, saved over always sampling at the fastest rate
+    if (report.fixedRateSamples > 0 && report.samples <= report.fixedRateSamples) {
+        responseDoc["savedPercent"] = 100.0 * (report.fixedRateSamples - report.samples) / report.fixedRateSamples;
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
 
-    
-    request->send(200, "application/json", response);
+// When relay node polls arrive: gaps between consecutive polls in power-of-two buckets, and where in a
+// minute they fall. Bursts show up as a heavy first few gap buckets and an uneven phase.
+server.on("/pollHistogram", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
+
+    JsonDocument responseDoc;
+    responseDoc["requests"] = pollArrivals.count();
+    JsonArray gaps = responseDoc["gapsMs"].to<JsonArray>();
+    for (uint32_t i = 0; i < ARRIVAL_GAP_BUCKETS; i++) {
+        JsonObject bucket = gaps.add<JsonObject>();
+        bucket["from"] = i == 0 ? 0 : 1 << i;
+        bucket["count"] = pollArrivals.gapCount(i);
+    }
+    JsonArray phases = responseDoc["phaseMs"].to<JsonArray>();
+    for (uint32_t i = 0; i < ARRIVAL_PHASE_BUCKETS; i++) {
+        JsonObject bucket = phases.add<JsonObject>();
+        bucket["from"] = i * ARRIVAL_PHASE_WINDOW_MS / ARRIVAL_PHASE_BUCKETS;
+        bucket["count"] = pollArrivals.phaseCount(i);
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
 });
 
-server.on("/setdefaultoff", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    JsonDocument jsonDoc;
-     Serial.print("here in post"); 
-    DeserializationError error = deserializeJson(jsonDoc, (const char*)data);
+// ESP-NOW link counters and the relay nodes that acknowledged over it, with their relay states and the
+// round trip from broadcast to acknowledgement. Also counts the UDP beacons sent.
+server.on("/radio", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
 
+    RadioReport report = radioReport.read();
+    JsonDocument responseDoc;
+    responseDoc["framesSent"] = report.framesSent;
+    responseDoc["sendFailures"] = report.sendFailures;
+    responseDoc["acksReceived"] = report.acksReceived;
+    responseDoc["acksDropped"] = report.acksDropped;
+    responseDoc["acksReplayed"] = report.acksReplayed;
+    responseDoc["badFrames"] = report.badFrames;
+    responseDoc["beaconsSent"] = beaconsSent.load(std::memory_order_relaxed);
+    JsonArray nodes = responseDoc["nodes"].to<JsonArray>();
+    uint32_t now = millis();
+    for (uint32_t i = 0; i < report.count; i++) {
+        const RadioNode &node = report.nodes[i];
+        char mac[18];
+        snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", node.address[0], node.address[1], node.address[2],
+                 node.address[3], node.address[4], node.address[5]);
+        JsonObject entry = nodes.add<JsonObject>();
+        entry["mac"] = mac;
+        entry["acks"] = node.acks;
+        entry["lastAckAgeMs"] = now - node.lastAckMs;
+        entry["roundTripUs"] = node.roundTripUs;
+        entry["maxRoundTripUs"] = node.maxRoundTripUs;
+        entry["channels"] = node.channels;
+        entry["loadOnMask"] = node.loadOnMask;
+        entry["switches"] = node.switches;
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
 
-    
-    if (error) {
-        request->send(400, "application/json", "{\"error\":\"Invalid JSON format\"}");
+// What the relay nodes report about themselves in the query of their polls: their poll connections,
+// parse heap and beacon and radio frame counts, and for duty-cycled nodes the time awake and the
+// estimated average current over the cycle before the poll.
+server.on("/nodes", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
         return;
     }
 
+    JsonDocument responseDoc;
+    JsonArray list = responseDoc["nodes"].to<JsonArray>();
+    uint32_t now = millis();
+    for (uint32_t i = 0; i < nodeStatus.size(); i++) {
+        const NodeStatus &node = nodeStatus.entry(i);
+        JsonObject entry = list.add<JsonObject>();
+        entry["nodeId"] = node.nodeId;
+        entry["polls"] = node.polls;
+        entry["lastPollAgeMs"] = now - node.lastPollMs;
+        entry["connects"] = node.connects;
+        entry["reuses"] = node.reuses;
+        entry["parseHeap"] = node.parseHeap;
+        entry["beacons"] = node.beacons;
+        entry["radioFrames"] = node.radioFrames;
+        entry["radioRejected"] = node.radioRejected;
+        if (node.awakeMs != 0) {
+            entry["awakeMs"] = node.awakeMs;
+            entry["averageUa"] = node.averageUa;
+        }
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
 
-    int newPercentage = jsonDoc["percentage"].as<int>();
-    setPercentageForOff = newPercentage;
-    EEPROM.write(setPercentageOffAddress, newPercentage);
-    EEPROM.commit();
+// Stations associated with the softAP, how long each has been idle, and how many were evicted to make
+// room for others.
+server.on("/stations", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
 
-    request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Percentage updated\"}");
+    StationReport report = stationReport.read();
+    JsonDocument responseDoc;
+    responseDoc["count"] = report.count;
+    responseDoc["maxStations"] = report.maxStations;
+    responseDoc["associations"] = report.associations;
+    responseDoc["departures"] = report.departures;
+    responseDoc["evictions"] = report.evictions;
+    JsonArray list = responseDoc["stations"].to<JsonArray>();
+    uint32_t now = millis();
+    for (uint32_t i = 0; i < report.count; i++) {
+        const StationEntry &station = report.stations[i];
+        char mac[18];
+        snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", station.mac[0], station.mac[1], station.mac[2],
+                 station.mac[3], station.mac[4], station.mac[5]);
+        JsonObject entry = list.add<JsonObject>();
+        entry["mac"] = mac;
+        entry["ip"] = IPAddress(station.ip).toString();
+        entry["connectedMs"] = now - station.associatedMs;
+        entry["idleMs"] = now - station.lastActiveMs;
+    }
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
 });
-server.on("/deleteDevice", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+
+// Power state and estimated consumption since boot. The monitor runs at full speed with the backlight
+// on unless low power mode is turned on with POST {"lowPower": true}; the choice survives a reboot.
+server.on("/power", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
+
+    PowerReport report = powerReport.read();
+    JsonDocument responseDoc;
+    responseDoc["lowPower"] = report.lowPower;
+    responseDoc["cpuMhz"] = report.cpuMhz;
+    responseDoc["backlight"] = report.backlight;
+    responseDoc["lightSleeps"] = report.sleeps;
+    responseDoc["dutyCycle"] = powerDutyCycle(report);
+    responseDoc["estimatedMa"] = powerAverageMa(report, powerProfile);
+    responseDoc["fastMs"] = report.fastUs / 1000;
+    responseDoc["slowMs"] = report.slowUs / 1000;
+    responseDoc["sleepMs"] = report.sleepUs / 1000;
+    sendDocument(request, 200, responseDoc, negotiateWireFormat(request));
+});
+server.on("/power", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (!admitBody(request, len, index, total)) {
+        return;
+    }
+
     JsonDocument jsonDoc;
-    DeserializationError error = deserializeJson(jsonDoc, (const char*)data);
-    
-    if (error) {
-        request->send(400, "application/json", "{\"error\":\"Invalid JSON format\"}");
+    DeserializationError error = parseRequestBody(request, data, len, jsonDoc);
+    if (error || !jsonDoc["lowPower"].is<bool>()) {
+        sendError(request, 400, "Invalid JSON format");
         return;
     }
 
-    String deviceId = jsonDoc["deviceId"].as<String>();
-    bool deleted = deleteDeviceFromEEPROM(deviceId);
+    uint32_t seq = postCommand(COMMAND_SET_LOW_POWER, NULL, jsonDoc["lowPower"].as<bool>() ? 1 : 0);
+    if (seq == 0) {
+        sendError(request, 503, "Command queue full");
+        return;
+    }
 
-    if (deleted) {
-        request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Device deleted\"}");
-    } else {
-        request->send(404, "application/json", "{\"error\":\"Device not found\"}");
+    sendAccepted(request, seq, "Power mode update queued");
+});
+
+// Browser dashboard, see web/ and scripts/embed_dashboard.py. The script has a content-hashed path so
+// it is cached for good; the page itself is revalidated with its ETag and usually costs a 304.
+server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
     }
+
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == DASHBOARD_INDEX_ETAG) {
+        request->send(304);
+        return;
+    }
+    sendGzipAsset(request, "text/html", DASHBOARD_INDEX_HTML_GZ, DASHBOARD_INDEX_HTML_GZ_LEN, "no-cache", DASHBOARD_INDEX_ETAG);
 });
 
+server.on(DASHBOARD_APP_JS_PATH, HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, RATE_READ)) {
+        return;
+    }
+
+    sendGzipAsset(request, "application/javascript", DASHBOARD_APP_JS_GZ, DASHBOARD_APP_JS_GZ_LEN, "public, max-age=31536000, immutable", NULL);
+});
+
+  // Subscribing counts as use of the station; the subscriber's heartbeat polls keep it that way.
+  events.onConnect([](AsyncEventSourceClient *client) {
+    stationSeenMs[client->client()->remoteIP()[3]].store(millis(), std::memory_order_relaxed);
+  });
+  server.addHandler(&events);
   server.begin();
 
 
@@ -344,58 +1537,295 @@ server.on("/deleteDevice", HTTP_POST, [](AsyncWebServerRequest *request) {}, NUL
 }
 
 /**
- * The function `buttonToSetPercentageOff` allows toggling between setting modes and adjusting a
- * percentage value based on button inputs.
+ * The function `admitRequest` charges a request to its client's token bucket. Refused requests get a
+ * bare 429 right away, before the body is parsed or any other work is done.
+ *
+ * @param rateClass `RATE_WRITE` for anything that ends up in flash, `RATE_READ` otherwise.
+ *
+ * @return true if the handler should go on, false if a 429 was already sent.
  */
-void buttonToSetPercentageOff() {
-  // Check if the menu button is pressed to toggle between modes
-  if (digitalRead(MENU_PIN) == LOW) {  // Button press is LOW due to pull-up
-    delay(200);  // Debounce delay to prevent multiple toggles
-    inVoltageSettingMode = !inVoltageSettingMode;  // Toggle mode
-    lcd.clear();
-    
-    if (inVoltageSettingMode) {
-      lcd.setCursor(0, 0);
-      lcd.print("Set Mode Active");
-      lcd.setCursor(0, 1);
-      lcd.print("Set Percentage: ");
-    } else {
-      lcd.setCursor(0, 0);
-      lcd.print("Exiting Mode");
+bool admitRequest(AsyncWebServerRequest *request, RateClass rateClass) {
+  lastRequestMs.store(millis(), std::memory_order_relaxed);  // Keeps the monitor awake, see powerTask()
+  stationSeenMs[request->client()->remoteIP()[3]].store(millis(), std::memory_order_relaxed);  // See stationTask()
+  uint32_t retryAfterMs = 0;
+  if (rateLimiter.allow((uint32_t)request->client()->remoteIP(), rateClass, millis(), &retryAfterMs)) {
+    return true;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse(429);
+  response->addHeader("Retry-After", String((retryAfterMs + 999) / 1000));
+  request->send(response);
+  return false;
+}
+
+/**
+ * The function `admitBody` is `admitRequest` for the body callback of a POST endpoint, which runs once
+ * per received chunk: only the first chunk is charged. The handlers parse the body in one piece, so a
+ * body that did not arrive in one chunk is refused there and the rest of it ignored.
+ *
+ * @return true if the handler should parse `data` and answer.
+ */
+bool admitBody(AsyncWebServerRequest *request, size_t len, size_t index, size_t total) {
+  if (index != 0) {
+    return false;  // Charged and answered with the first chunk
+  }
+  if (!admitRequest(request, RATE_WRITE)) {
+    return false;
+  }
+  if (len != total) {
+    sendError(request, 413, "Request body too large");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * The function `uintParam` reads an unsigned query parameter.
+ *
+ * @return Its value, or 0 if it is missing or not a number.
+ */
+uint32_t uintParam(AsyncWebServerRequest *request, const char *name) {
+  if (!request->hasParam(name)) {
+    return 0;
+  }
+  return strtoul(request->getParam(name)->value().c_str(), NULL, 10);
+}
+
+/**
+ * The function `sendGzipAsset` streams a dashboard file straight from flash as it was compressed at
+ * build time, so serving it costs no compression and no RAM copy.
+ *
+ * @param cacheControl Value of the `Cache-Control` header.
+ * @param etag Value of the `ETag` header, or NULL to leave it out.
+ */
+void sendGzipAsset(AsyncWebServerRequest *request, const char *contentType, const uint8_t *data, size_t len, const char *cacheControl, const char *etag) {
+  AsyncWebServerResponse *response = request->beginResponse_P(200, contentType, data, len);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("Cache-Control", cacheControl);
+  if (etag != NULL) {
+    response->addHeader("ETag", etag);
+  }
+  request->send(response);
+}
+
+/**
+ * The function `postCommand` queues a settings change for `applyCommands`. It is called from the HTTP
+ * handlers and only copies a few bytes, so requests return without waiting for EEPROM.
+ *
+ * @param deviceId Target device for per-device commands, NULL otherwise. Longer IDs are truncated to
+ * what fits in an EEPROM block.
+ *
+ * @return The sequence number to report back to the client, or 0 if the queue was full.
+ */
+uint32_t postCommand(CommandType type, const char *deviceId, int value) {
+  Command command = makeCommand(type, deviceId, value);
+  if (!commandQueue.push(command)) {
+    return 0;
+  }
+  return command.seq;
+}
+
+// Builds a command with the next sequence number, for `postCommand` or a batch.
+Command makeCommand(CommandType type, const char *deviceId, int value) {
+  Command command;
+  command.seq = commandAcks.next();
+  command.type = type;
+  command.value = value;
+  command.deviceId[0] = 0;
+  if (deviceId != NULL) {
+    strncpy(command.deviceId, deviceId, DEVICE_ID_SIZE);
+    command.deviceId[DEVICE_ID_SIZE] = 0;
+  }
+  return command;
+}
+
+/**
+ * The function `applyCommands` drains the command queue on the service task, which is the only place
+ * that writes `setPercentageForOff` or the EEPROM. Each command is acknowledged in `commandAcks`;
+ * button events carry no sequence number and are only applied.
+ */
+void applyCommands() {
+  Command command;
+  uint32_t seqs[COMMAND_QUEUE_SIZE];
+  CommandResult results[COMMAND_QUEUE_SIZE];
+  int count = 0;
+  int popped = 0;
+  bool pressed = false;
+  bool thresholdsChanged = false;
+
+  // Bounded so a flood of requests cannot starve sampling.
+  while (popped < COMMAND_QUEUE_SIZE && commandQueue.pop(command)) {
+    popped++;
+    CommandResult result = COMMAND_APPLIED;
+
+    if (command.type == COMMAND_BUTTON_EVENT) {
+      handleButtonEvent((ButtonId)(command.value >> 8), (ButtonEvent)(command.value & 0xff));
+      pressed = true;
+      continue;
+    }
+
+    switch (command.type) {
+      case COMMAND_SET_DEFAULT_OFF:
+        thresholdsChanged = thresholdsChanged || command.value != setPercentageForOff;
+        setPercentageForOff = command.value;
+        EEPROM.write(setPercentageOffAddress, command.value);
+        break;
+      case COMMAND_SET_DEVICE_PERCENTAGE:
+        storePercentageByDeviceId(command.deviceId, command.value);
+        thresholdsChanged = true;
+        break;
+      case COMMAND_DELETE_DEVICE:
+        if (!deleteDeviceFromEEPROM(command.deviceId)) {
+          result = COMMAND_NOT_FOUND;
+        } else {
+          thresholdsChanged = true;
+        }
+        break;
+      case COMMAND_SET_LOW_POWER:
+        lowPowerMode = command.value != 0;
+        EEPROM.write(lowPowerAddress, lowPowerMode ? 1 : 0);
+        powerTask();
+        break;
+      default:
+        break;
     }
+    seqs[count] = command.seq;
+    results[count] = result;
+    count++;
+  }
 
-    delay(500);  // Additional delay to avoid immediate toggling
+  // Publishing thresholds bumps their generation and makes every relay node refetch, so it is left for
+  // changes to a threshold rather than any button press or command. UP and DOWN in set mode only change
+  // the local value, and it is published once on leaving set mode rather than at every step.
+  thresholdsChanged = thresholdsChanged || (!inVoltageSettingMode && setPercentageForOff != publishedPercentageForOff);
+  if (pressed) {
+    powerPolicy.input(millis());
+    powerTask();  // Light the backlight and speed up right away
+    publishTelemetry();
+    if (thresholdsChanged && count == 0) {
+      publishThresholds();
+    }
+    displayTask();  // Show the result of a press now rather than at the next display period
+  }
+  if (count == 0) {
+    return;
   }
 
-  // Only adjust voltage if in the setting mode
-  if (inVoltageSettingMode) {
-    // Display the set voltage on the LCD
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("Set Percentage: ");
-    lcd.setCursor(0, 1);
-    lcd.print(setPercentageForOff);
-    lcd.print("%");
+  // One flash commit for the whole batch, and only then tell clients it is stored.
+  EEPROM.commit();
+  publishTelemetry();
+  if (thresholdsChanged) {
+    publishThresholds();
+  }
+  for (int i = 0; i < count; i++) {
+    commandAcks.complete(seqs[i], results[i]);
+  }
+}
 
-    // Check if the up button is pressed to increase voltage
-    if (digitalRead(UP_PIN) == LOW) {  // Button press is LOW due to pull-up
-      if (setPercentageForOff < 100) {
-        setPercentageForOff++;
-        delay(200);  // Add a short delay to prevent rapid incrementing
-      }
+/**
+ * The function `publishTelemetry` copies the service task's working state into `telemetry` in one go, so
+ * HTTP handlers always see a percentage, system type and threshold that belong together. It must only
+ * be called from the service task.
+ */
+void publishTelemetry() {
+  Telemetry snapshot;
+  snapshot.voltage = lastVoltage;
+  snapshot.percentage = percentage;
+  snapshot.systemType = systemType;
+  snapshot.setPercentageForOff = setPercentageForOff;
+  snapshot.sampleCount = sampleCount;
+  snapshot.sampledAtMs = lastSampleMs;
+  for (int i = 0; i < TELEMETRY_WINDOW_COUNT; i++) {
+    snapshot.voltageWindows[i] = voltageWindows[i].summary();
+  }
+  telemetry.write(snapshot);
+}
+
+/**
+ * The function `onButtonEdge` runs on every edge of a button pin and (re)starts the button's timer,
+ * so its state machine runs once the pin has stopped bouncing for `BUTTON_DEBOUNCE_MS`.
+ *
+ * @param arg The `ButtonId`.
+ */
+void IRAM_ATTR onButtonEdge(void *arg) {
+  BaseType_t woken = pdFALSE;
+  xTimerChangePeriodFromISR(buttonTimers[(intptr_t)arg], pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+/**
+ * The function `onButtonTimer` runs on the FreeRTOS timer task with a debounced pin level. It steps
+ * the button's state machine, queues any event for the service task, and re-arms the timer while a long
+ * press or auto-repeat deadline is pending.
+ */
+void onButtonTimer(TimerHandle_t timer) {
+  intptr_t id = (intptr_t)pvTimerGetTimerID(timer);
+  ButtonMachine &button = buttons[id];
+  uint32_t now = millis();
+
+  // Buttons read LOW when pressed due to the pull-ups
+  ButtonEvent event = button.update(digitalRead(buttonPins[id]) == LOW, now);
+  if (event != BUTTON_EVENT_NONE) {
+    Command command;
+    command.seq = 0;
+    command.type = COMMAND_BUTTON_EVENT;
+    command.value = id << 8 | event;
+    command.deviceId[0] = 0;
+    commandQueue.push(command);  // A press is simply lost if the queue is full
+  }
+
+  if (button.waiting()) {
+    int32_t waitMs = (int32_t)(button.deadlineMs() - now);
+    xTimerChangePeriod(timer, pdMS_TO_TICKS(waitMs > 0 ? waitMs : 1), 0);
+  }
+}
+
+/**
+ * The function `setupButtons` configures the button pins and attaches their edge interrupts.
+ */
+void setupButtons() {
+  for (intptr_t i = 0; i < BUTTON_COUNT; i++) {
+    pinMode(buttonPins[i], INPUT_PULLUP);
+    buttonTimers[i] = xTimerCreate("button", pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), pdFALSE, (void *)i, onButtonTimer);
+    attachInterruptArg(buttonPins[i], onButtonEdge, (void *)i, CHANGE);
+  }
+}
+
+/**
+ * The function `handleButtonEvent` applies a button event on the service task: MENU toggles the setting
+ * mode, and UP and DOWN adjust `setPercentageForOff` while in it, once per press and then repeatedly
+ * while held. The new value reaches the relay nodes when set mode is left, see `applyCommands`.
+ */
+void handleButtonEvent(ButtonId button, ButtonEvent event) {
+  if (button == BUTTON_MENU) {
+    if (event != BUTTON_EVENT_PRESS) {
+      return;
     }
+    inVoltageSettingMode = !inVoltageSettingMode;  // Toggle mode
 
-    // Check if the down button is pressed to decrease voltage
-    if (digitalRead(DOWN_PIN) == LOW) {  // Button press is LOW due to pull-up
-      if (setPercentageForOff > 0) {
-        setPercentageForOff--;
-        delay(200);  // Add a short delay to prevent rapid decrementing
-      }
+    messageFrame.clear();
+    if (inVoltageSettingMode) {
+      messageFrame.print(0, 0, "Set Mode Active");
+      messageFrame.print(0, 1, "Set Percentage: ");
+    } else {
+      messageFrame.print(0, 0, "Exiting Mode");
+      persistTask();  // Save the new threshold now rather than at the next period
     }
+    messageUntilMs = millis() + MESSAGE_SHOW_MS;
+    return;
+  }
 
-    // Save the new set voltage to EEPROM
-    EEPROM.write(setPercentageOffAddress, setPercentageForOff);
-    EEPROM.commit();
+  // Only adjust the percentage if in the setting mode
+  if (!inVoltageSettingMode || event == BUTTON_EVENT_RELEASE) {
+    return;
+  }
+  if (button == BUTTON_UP && setPercentageForOff < 100) {
+    setPercentageForOff++;
+  }
+  if (button == BUTTON_DOWN && setPercentageForOff > 0) {
+    setPercentageForOff--;
   }
 }
 
@@ -460,12 +1890,35 @@ void storePercentageByDeviceId(String deviceId, int percentage) {
     writePercentageToEEPROM(deviceBlockAddress + DEVICE_ID_SIZE, percentage);
       Serial.println("Updated device: " + deviceId + " with new percentage: " + String(percentage));
   }
-
-  EEPROM.commit();  // Save changes to EEPROM
+  // Committed by applyCommands() together with the rest of the batch
 }
 
 
 
+/**
+ * The function `devicePollSlot` picks the poll slot of a device: its EEPROM block, so registered
+ * devices never share one, or a hash of its ID for devices without a block.
+ */
+uint32_t devicePollSlot(const DeviceTable &table, const String &deviceId) {
+  const DeviceEntry *device = findDevice(table, deviceId.c_str());
+  if (device != NULL) {
+    return device->block;
+  }
+  return wireFnv1a(WIRE_FNV_OFFSET, deviceId.c_str(), deviceId.length()) % MAX_DEVICES;
+}
+
+/**
+ * The function `addPollSchedule` adds the poll schedule to a reply: `pollIntervalMs` between polls,
+ * `pollSlotMs` as the slot's offset within the interval and `nextPollMs` until that slot comes round
+ * next.
+ */
+void addPollSchedule(JsonDocument &doc, uint32_t slot, uint32_t intervalMs) {
+  uint32_t slotMs = pollSlotMs(slot, MAX_DEVICES, intervalMs);
+  doc["pollIntervalMs"] = intervalMs;
+  doc["pollSlotMs"] = slotMs;
+  doc["nextPollMs"] = pollDelayMs(slotMs, intervalMs, millis());
+}
+
 /**
  * This C++ function retrieves the percentage value associated with a device ID from EEPROM memory.
  * 
@@ -578,7 +2031,6 @@ bool deleteDeviceFromEEPROM(String deviceId) {
     for (int i = 0; i < DEVICE_BLOCK_SIZE; i++) {
       EEPROM.write(deviceBlockAddress + i, 0);
     }
-    EEPROM.commit();
     return true;
   }
 
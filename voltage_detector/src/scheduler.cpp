@@ -0,0 +1,96 @@
+#include <scheduler/scheduler.h>
+
+Scheduler::Scheduler(SchedulerClock clock) : clock(clock), count(0) {}
+
+int Scheduler::add(const char *name, uint32_t periodMs, SchedulerTaskFunction run) {
+  if (count >= SCHEDULER_MAX_TASKS) {
+    return -1;
+  }
+
+  Task &task = tasks[count];
+  task.stats.name = name;
+  task.stats.periodMs = periodMs;
+  task.stats.runs = 0;
+  task.stats.overruns = 0;
+  task.stats.maxLatenessUs = 0;
+  task.stats.lastDurationUs = 0;
+  task.stats.maxDurationUs = 0;
+  task.run = run;
+  task.nextDueUs = clock();
+  return count++;
+}
+
+void Scheduler::setPeriod(int task, uint32_t periodMs) {
+  if (task < 0 || (size_t)task >= count) {
+    return;
+  }
+  Task &target = tasks[task];
+  // Pull the deadline in if the new rate is faster, so a speed-up takes effect right away.
+  uint32_t now = clock();
+  if ((int32_t)(target.nextDueUs - (now + periodMs * 1000)) > 0) {
+    target.nextDueUs = now + periodMs * 1000;
+  }
+  target.stats.periodMs = periodMs;
+}
+
+uint32_t Scheduler::tick() {
+  // Each pass picks the most overdue task, so a slow task delays the others by at most one run.
+  for (size_t ran = 0; ran < count; ran++) {
+    uint32_t now = clock();
+    Task *due = NULL;
+    for (size_t i = 0; i < count; i++) {
+      if ((int32_t)(now - tasks[i].nextDueUs) >= 0 &&
+          (due == NULL || (int32_t)(tasks[i].nextDueUs - due->nextDueUs) < 0)) {
+        due = &tasks[i];
+      }
+    }
+    if (due == NULL) {
+      break;
+    }
+
+    uint32_t periodUs = due->stats.periodMs * 1000;
+    uint32_t lateness = now - due->nextDueUs;
+    if (lateness > due->stats.maxLatenessUs) {
+      due->stats.maxLatenessUs = lateness;
+    }
+
+    due->run();
+
+    uint32_t finished = clock();
+    due->stats.runs++;
+    due->stats.lastDurationUs = finished - now;
+    if (due->stats.lastDurationUs > due->stats.maxDurationUs) {
+      due->stats.maxDurationUs = due->stats.lastDurationUs;
+    }
+
+    // Fixed rate while on time; after an overrun restart from now instead of running a burst of
+    // catch-up iterations.
+    due->nextDueUs += periodUs;
+    if ((int32_t)(finished - due->nextDueUs) >= 0) {
+      due->stats.overruns++;
+      due->nextDueUs = finished + periodUs;
+    }
+  }
+
+  uint32_t now = clock();
+  uint32_t idle = UINT32_MAX;
+  for (size_t i = 0; i < count; i++) {
+    int32_t remaining = (int32_t)(tasks[i].nextDueUs - now);
+    if (remaining <= 0) {
+      return 0;
+    }
+    if ((uint32_t)remaining < idle) {
+      idle = remaining;
+    }
+  }
+  return idle;
+}
+
+SchedulerReport Scheduler::report() const {
+  SchedulerReport result;
+  result.count = count;
+  for (size_t i = 0; i < count; i++) {
+    result.tasks[i] = tasks[i].stats;
+  }
+  return result;
+}
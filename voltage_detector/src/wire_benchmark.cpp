@@ -0,0 +1,74 @@
+#ifdef WIRE_BENCHMARK
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <telemetry_wire.h>
+
+#define WIRE_BENCHMARK_ROUNDS 1000
+
+static void printResult(const char *name, size_t bytes, uint32_t cycles) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(bytes);
+  Serial.print(" bytes, ");
+  Serial.print(cycles / WIRE_BENCHMARK_ROUNDS);
+  Serial.println(" cycles/decode");
+}
+
+/**
+ * The function `runWireBenchmark` encodes a typical `/getVoltageById` reply in each supported format
+ * and prints the payload size and the average number of CPU cycles needed to decode it. It only exists
+ * in the `wire_benchmark` PlatformIO environment.
+ */
+void runWireBenchmark() {
+  JsonDocument source;
+  source["deviceId"] = "kitchen-fridge";
+  source["voltage"] = 35;
+  source["systemType"] = 24.0;
+  source["percentage"] = 63.5;
+
+  char json[128];
+  size_t jsonLen = serializeJson(source, json, sizeof(json));
+  uint8_t msgpack[128];
+  size_t msgpackLen = serializeMsgPack(source, msgpack, sizeof(msgpack));
+
+  WireDeviceTelemetryFrame frame;
+  wireInitHeader(frame.header, WIRE_FRAME_DEVICE_TELEMETRY, sizeof(frame));
+  strncpy(frame.deviceId, "kitchen-fridge", sizeof(frame.deviceId));
+  frame.threshold = 35;
+  frame.systemType = 24;
+  frame.percentageCenti = 6350;
+  uint8_t binary[sizeof(frame)];
+  memcpy(binary, &frame, sizeof(frame));
+
+  // `sink` keeps the compiler from dropping the decoded values.
+  volatile float sink = 0;
+  uint32_t start;
+  JsonDocument doc;
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    deserializeJson(doc, json, jsonLen);
+    sink = doc["percentage"].as<float>();
+  }
+  printResult("json", jsonLen, ESP.getCycleCount() - start);
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    deserializeMsgPack(doc, msgpack, msgpackLen);
+    sink = doc["percentage"].as<float>();
+  }
+  printResult("msgpack", msgpackLen, ESP.getCycleCount() - start);
+
+  start = ESP.getCycleCount();
+  for (int i = 0; i < WIRE_BENCHMARK_ROUNDS; i++) {
+    WireDeviceTelemetryFrame decoded;
+    if (wireDecode(binary, sizeof(binary), WIRE_FRAME_DEVICE_TELEMETRY, &decoded, sizeof(decoded))) {
+      sink = decoded.percentageCenti / 100.0;
+    }
+  }
+  printResult("binary", sizeof(binary), ESP.getCycleCount() - start);
+  (void)sink;
+}
+
+#endif
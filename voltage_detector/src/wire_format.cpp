@@ -0,0 +1,142 @@
+#include <wire_format/wire_format.h>
+
+/**
+ * The function `negotiateWireFormat` picks the response encoding from the request's `Accept` header.
+ * When a client lists several formats the most compact one wins; q-values are ignored since the only
+ * clients are our own relay nodes, the app and browsers.
+ *
+ * @param request The incoming request.
+ *
+ * @return The format to answer in, `WIRE_FORMAT_JSON` when no `Accept` header matches.
+ */
+WireFormat negotiateWireFormat(AsyncWebServerRequest *request) {
+  if (!request->hasHeader("Accept")) {
+    return WIRE_FORMAT_JSON;
+  }
+  const String &accept = request->getHeader("Accept")->value();
+
+  if (accept.indexOf(WIRE_MIME_BINARY) >= 0) {
+    return WIRE_FORMAT_BINARY;
+  }
+  if (accept.indexOf(WIRE_MIME_MSGPACK) >= 0 || accept.indexOf("application/x-msgpack") >= 0) {
+    return WIRE_FORMAT_MSGPACK;
+  }
+  return WIRE_FORMAT_JSON;
+}
+
+/**
+ * The function `parseRequestBody` deserializes a POST body as MessagePack when the client says so in
+ * `Content-Type`, and as JSON otherwise.
+ *
+ * @param data The body chunk handed to the body callback. It is not null terminated, so `len` is
+ * always passed along.
+ *
+ * @return The ArduinoJson error, `DeserializationError::Ok` on success.
+ */
+DeserializationError parseRequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, JsonDocument &doc) {
+  const String &contentType = request->contentType();
+
+  if (contentType.indexOf(WIRE_MIME_MSGPACK) >= 0 || contentType.indexOf("application/x-msgpack") >= 0) {
+    return deserializeMsgPack(doc, (const char *)data, len);
+  }
+  return deserializeJson(doc, (const char *)data, len);
+}
+
+/**
+ * The function `sendDocument` serializes `doc` straight into the response buffer in the negotiated
+ * format, without building an intermediate `String`.
+ *
+ * @param format The result of `negotiateWireFormat`. Handlers that have no binary frame for their
+ * payload pass `WIRE_FORMAT_BINARY` through and get JSON back.
+ */
+void sendDocument(AsyncWebServerRequest *request, int code, JsonDocument &doc, WireFormat format) {
+  AsyncResponseStream *response;
+
+  if (format == WIRE_FORMAT_MSGPACK) {
+    response = request->beginResponseStream(WIRE_MIME_MSGPACK);
+    serializeMsgPack(doc, *response);
+  } else {
+    response = request->beginResponseStream(WIRE_MIME_JSON);
+    serializeJson(doc, *response);
+  }
+  response->setCode(code);
+  request->send(response);
+}
+
+/**
+ * The function `sendFrame` sends one of the fixed-layout frames from `telemetry_wire.h`. The frame is
+ * copied into the response, so it can live on the caller's stack.
+ */
+void sendFrame(AsyncWebServerRequest *request, int code, const void *frame, size_t len) {
+  AsyncResponseStream *response = request->beginResponseStream(WIRE_MIME_BINARY);
+  response->write((const uint8_t *)frame, len);
+  response->setCode(code);
+  request->send(response);
+}
+
+static void sendStatusFrame(AsyncWebServerRequest *request, int code) {
+  WireStatusFrame frame;
+  wireInitHeader(frame.header, WIRE_FRAME_STATUS, sizeof(frame));
+  frame.httpStatus = code;
+  sendFrame(request, code, &frame, sizeof(frame));
+}
+
+/**
+ * The function `sendSuccess` replies with `{"status":"success","message":...}` in the negotiated
+ * format, or a `WireStatusFrame` for binary clients.
+ *
+ * @param message Optional message, left out of the reply when NULL.
+ */
+void sendSuccess(AsyncWebServerRequest *request, int code, const char *message) {
+  WireFormat format = negotiateWireFormat(request);
+  if (format == WIRE_FORMAT_BINARY) {
+    sendStatusFrame(request, code);
+    return;
+  }
+
+  JsonDocument doc;
+  doc["status"] = "success";
+  if (message != NULL) {
+    doc["message"] = message;
+  }
+  sendDocument(request, code, doc, format);
+}
+
+/**
+ * The function `sendError` replies with `{"error":...}` in the negotiated format, or a
+ * `WireStatusFrame` carrying the HTTP status for binary clients.
+ */
+void sendError(AsyncWebServerRequest *request, int code, const char *message) {
+  WireFormat format = negotiateWireFormat(request);
+  if (format == WIRE_FORMAT_BINARY) {
+    sendStatusFrame(request, code);
+    return;
+  }
+
+  JsonDocument doc;
+  doc["error"] = message;
+  sendDocument(request, code, doc, format);
+}
+
+/**
+ * The function `sendAccepted` answers 202 for a command that was queued rather than applied, with
+ * the sequence number to pass to `/commandStatus`. The reply keeps `"status":"success"` so clients
+ * that only check for that keep working.
+ */
+void sendAccepted(AsyncWebServerRequest *request, uint32_t seq, const char *message) {
+  WireFormat format = negotiateWireFormat(request);
+  if (format == WIRE_FORMAT_BINARY) {
+    WireAckFrame frame;
+    wireInitHeader(frame.header, WIRE_FRAME_ACK, sizeof(frame));
+    frame.httpStatus = 202;
+    frame.seq = seq;
+    sendFrame(request, 202, &frame, sizeof(frame));
+    return;
+  }
+
+  JsonDocument doc;
+  doc["status"] = "success";
+  doc["message"] = message;
+  doc["seq"] = seq;
+  sendDocument(request, 202, doc, format);
+}
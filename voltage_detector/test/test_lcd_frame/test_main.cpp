@@ -0,0 +1,174 @@
+#include <unity.h>
+#include <string.h>
+#include <lcd_frame/lcd_frame.h>
+
+// Stands in for the HD44780: keeps the characters it was sent at the cursor, advancing like the real
+// controller, and counts the bytes that reached it.
+class RecordingLcd : public LcdSink {
+ public:
+  RecordingLcd() : col(0), row(0), bytes(0), cursorMoves(0), writes(0) {
+    memset(screen, '?', sizeof(screen));  // Whatever was there at power-up
+  }
+
+  void setCursor(uint8_t newCol, uint8_t newRow) override {
+    col = newCol;
+    row = newRow;
+    bytes++;
+    cursorMoves++;
+  }
+
+  void write(const char *text, size_t len) override {
+    for (size_t i = 0; i < len; i++) {
+      TEST_ASSERT_LESS_THAN(LCD_COLS, col);  // The renderer never relies on wrapping
+      screen[row][col++] = text[i];
+    }
+    bytes += len;
+    writes++;
+  }
+
+  void showsRow(uint8_t r, const char *golden) {
+    char text[LCD_COLS + 1];
+    memcpy(text, screen[r], LCD_COLS);
+    text[LCD_COLS] = 0;
+    TEST_ASSERT_EQUAL_STRING(golden, text);
+  }
+
+  void resetCounts() {
+    bytes = 0;
+    cursorMoves = 0;
+    writes = 0;
+  }
+
+  char screen[LCD_ROWS][LCD_COLS];
+  uint8_t col;
+  uint8_t row;
+  size_t bytes;
+  size_t cursorMoves;
+  size_t writes;
+};
+
+// A full redraw: both rows from their first column.
+static const size_t FULL_REDRAW_BYTES = LCD_ROWS * (1 + LCD_COLS);
+
+static LcdFrame statusFrame(const char *percentage, const char *voltage) {
+  LcdFrame frame;
+  frame.printf(0, 0, "Batt: %s%%", percentage);
+  frame.printf(0, 1, "Volt: %sV", voltage);
+  return frame;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_print_clips_at_the_end_of_the_row() {
+  LcdFrame frame;
+  frame.print(10, 0, "0123456789");
+  frame.print(0, 2, "off screen");
+  char row[LCD_COLS + 1] = {};
+  memcpy(row, frame.cells[0], LCD_COLS);
+  TEST_ASSERT_EQUAL_STRING("          012345", row);
+  memcpy(row, frame.cells[1], LCD_COLS);
+  TEST_ASSERT_EQUAL_STRING("                ", row);
+}
+
+void test_first_render_is_a_full_redraw() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  size_t bytes = renderer.render(statusFrame("63.5", "25.12"));
+  lcd.showsRow(0, "Batt: 63.5%     ");
+  lcd.showsRow(1, "Volt: 25.12V    ");
+  TEST_ASSERT_EQUAL(FULL_REDRAW_BYTES, bytes);
+  TEST_ASSERT_EQUAL(FULL_REDRAW_BYTES, lcd.bytes);
+}
+
+void test_unchanged_frame_sends_nothing() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  renderer.render(statusFrame("63.5", "25.12"));
+  lcd.resetCounts();
+  TEST_ASSERT_EQUAL(0, renderer.render(statusFrame("63.5", "25.12")));
+  TEST_ASSERT_EQUAL(0, lcd.bytes);
+}
+
+void test_one_digit_costs_a_cursor_move_and_a_character() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  renderer.render(statusFrame("63.5", "25.12"));
+  lcd.resetCounts();
+  size_t bytes = renderer.render(statusFrame("63.6", "25.12"));
+  lcd.showsRow(0, "Batt: 63.6%     ");
+  lcd.showsRow(1, "Volt: 25.12V    ");
+  TEST_ASSERT_EQUAL(2, bytes);
+  TEST_ASSERT_LESS_THAN(FULL_REDRAW_BYTES / 10, bytes);
+}
+
+void test_changes_one_cell_apart_are_merged() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  renderer.render(statusFrame("63.5", "25.12"));
+  lcd.resetCounts();
+  // "25.12" to "25.34": two changed cells side by side
+  // "63.5" to "64.7": changes at cols 7 and 9 with the unchanged '.' between them
+  size_t bytes = renderer.render(statusFrame("64.7", "25.34"));
+  lcd.showsRow(0, "Batt: 64.7%     ");
+  lcd.showsRow(1, "Volt: 25.34V    ");
+  TEST_ASSERT_EQUAL(2, lcd.cursorMoves);
+  TEST_ASSERT_EQUAL(2, lcd.writes);
+  TEST_ASSERT_EQUAL(2 + 3 + 2, bytes);
+}
+
+void test_changes_further_apart_are_separate_runs() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  LcdFrame frame;
+  frame.print(0, 0, "A..............B");
+  renderer.render(frame);
+  lcd.resetCounts();
+  frame.print(0, 0, "X..............Y");
+  size_t bytes = renderer.render(frame);
+  lcd.showsRow(0, "X..............Y");
+  TEST_ASSERT_EQUAL(2 * 2, bytes);
+}
+
+void test_invalidate_forces_a_full_redraw() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  renderer.render(statusFrame("63.5", "25.12"));
+  memset(lcd.screen, '?', sizeof(lcd.screen));  // The display was reset behind the renderer's back
+  renderer.invalidate();
+  lcd.resetCounts();
+  TEST_ASSERT_EQUAL(FULL_REDRAW_BYTES, renderer.render(statusFrame("63.5", "25.12")));
+  lcd.showsRow(0, "Batt: 63.5%     ");
+  lcd.showsRow(1, "Volt: 25.12V    ");
+}
+
+void test_a_minute_of_updates_costs_a_fraction_of_redraws() {
+  RecordingLcd lcd;
+  LcdRenderer renderer(lcd);
+  char percentage[8];
+  char voltage[8];
+  size_t updates = 240;  // One a quarter second, as the display job runs
+  for (size_t i = 0; i < updates; i++) {
+    snprintf(percentage, sizeof(percentage), "%.1f", 63.5 - i * 0.01);
+    snprintf(voltage, sizeof(voltage), "%.2f", 25.12 - i * 0.001);
+    renderer.render(statusFrame(percentage, voltage));
+  }
+  lcd.showsRow(0, "Batt: 61.1%     ");
+  lcd.showsRow(1, "Volt: 24.88V    ");
+  TEST_ASSERT_EQUAL(lcd.bytes, renderer.bytesSent());
+  TEST_ASSERT_LESS_THAN(updates * FULL_REDRAW_BYTES / 5, renderer.bytesSent());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_print_clips_at_the_end_of_the_row);
+  RUN_TEST(test_first_render_is_a_full_redraw);
+  RUN_TEST(test_unchanged_frame_sends_nothing);
+  RUN_TEST(test_one_digit_costs_a_cursor_move_and_a_character);
+  RUN_TEST(test_changes_one_cell_apart_are_merged);
+  RUN_TEST(test_changes_further_apart_are_separate_runs);
+  RUN_TEST(test_invalidate_forces_a_full_redraw);
+  RUN_TEST(test_a_minute_of_updates_costs_a_fraction_of_redraws);
+  return UNITY_END();
+}
@@ -0,0 +1,67 @@
+#include <unity.h>
+#include <stdio.h>
+#include <nodes/node_status.h>
+
+static NodeStatusTable table;
+
+void setUp() {
+  table = NodeStatusTable();
+}
+
+void tearDown() {}
+
+void test_polls_by_the_same_node_share_an_entry() {
+  NodeStatus &first = table.record("kitchen", 1000);
+  first.awakeMs = 850;
+  first.averageUa = 412;
+  table.record("garage", 1500);
+  NodeStatus &again = table.record("kitchen", 61000);
+
+  TEST_ASSERT_EQUAL_UINT32(2, table.size());
+  TEST_ASSERT_EQUAL_UINT32(2, again.polls);
+  TEST_ASSERT_EQUAL_UINT32(61000, again.lastPollMs);
+  TEST_ASSERT_EQUAL_UINT32(850, again.awakeMs);  // Kept until the poll reports new figures
+  TEST_ASSERT_EQUAL_UINT32(412, again.averageUa);
+}
+
+void test_full_table_drops_the_node_silent_longest() {
+  char nodeId[8];
+  for (uint32_t i = 0; i < NODE_STATUS_SIZE; i++) {
+    snprintf(nodeId, sizeof(nodeId), "node%u", (unsigned)i);
+    table.record(nodeId, 1000 + i);
+  }
+  table.record("node0", 5000);  // node1 is now the stalest
+  table.record("newcomer", 6000).awakeMs = 900;
+
+  TEST_ASSERT_EQUAL_UINT32(NODE_STATUS_SIZE, table.size());
+  bool node1Kept = false;
+  bool newcomerKept = false;
+  for (uint32_t i = 0; i < table.size(); i++) {
+    node1Kept = node1Kept || strcmp(table.entry(i).nodeId, "node1") == 0;
+    if (strcmp(table.entry(i).nodeId, "newcomer") == 0) {
+      newcomerKept = true;
+      TEST_ASSERT_EQUAL_UINT32(1, table.entry(i).polls);
+      TEST_ASSERT_EQUAL_UINT32(900, table.entry(i).awakeMs);
+    }
+  }
+  TEST_ASSERT_FALSE(node1Kept);
+  TEST_ASSERT_TRUE(newcomerKept);
+}
+
+void test_long_node_id_is_cut_and_terminated() {
+  const char *longId = "a-device-id-well-past-the-thirty-one-characters-kept";
+  table.record(longId, 1000);
+  table.record(longId, 2000);
+
+  TEST_ASSERT_EQUAL_UINT32(1, table.size());
+  TEST_ASSERT_EQUAL_UINT32(2, table.entry(0).polls);
+  TEST_ASSERT_EQUAL_UINT32(NODE_ID_SIZE - 1, strlen(table.entry(0).nodeId));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_polls_by_the_same_node_share_an_entry);
+  RUN_TEST(test_full_table_drops_the_node_silent_longest);
+  RUN_TEST(test_long_node_id_is_cut_and_terminated);
+  return UNITY_END();
+}
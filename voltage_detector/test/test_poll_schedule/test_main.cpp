@@ -0,0 +1,55 @@
+#include <unity.h>
+#include <poll_schedule/poll_schedule.h>
+
+static const PollScheduleConfig config = {5000, 60000, 2.0f, 20.0f};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_interval_follows_distance_to_threshold() {
+  TEST_ASSERT_EQUAL_UINT32(5000, pollIntervalMs(config, 31.0f, 30.0f));
+  TEST_ASSERT_EQUAL_UINT32(5000, pollIntervalMs(config, 29.0f, 30.0f));
+  TEST_ASSERT_EQUAL_UINT32(60000, pollIntervalMs(config, 80.0f, 30.0f));
+  TEST_ASSERT_EQUAL_UINT32(32500, pollIntervalMs(config, 41.0f, 30.0f));
+}
+
+void test_slots_spread_over_the_interval() {
+  TEST_ASSERT_EQUAL_UINT32(0, pollSlotMs(0, 20, 60000));
+  TEST_ASSERT_EQUAL_UINT32(3000, pollSlotMs(1, 20, 60000));
+  TEST_ASSERT_EQUAL_UINT32(57000, pollSlotMs(19, 20, 60000));
+  TEST_ASSERT_EQUAL_UINT32(3000, pollSlotMs(21, 20, 60000));
+}
+
+void test_delay_runs_to_the_next_slot() {
+  TEST_ASSERT_EQUAL_UINT32(2000, pollDelayMs(3000, 60000, 1000));
+  TEST_ASSERT_EQUAL_UINT32(59000, pollDelayMs(3000, 60000, 4000));
+  TEST_ASSERT_EQUAL_UINT32(2000, pollDelayMs(3000, 60000, 121000));
+}
+
+void test_poll_on_its_slot_waits_a_whole_interval() {
+  // Answering 0 here sent the node straight back for a second poll
+  TEST_ASSERT_EQUAL_UINT32(60000, pollDelayMs(3000, 60000, 3000));
+  TEST_ASSERT_EQUAL_UINT32(60000, pollDelayMs(0, 60000, 120000));
+  for (uint32_t nowMs = 0; nowMs < 20000; nowMs += 7) {
+    uint32_t delayMs = pollDelayMs(1500, 5000, nowMs);
+    TEST_ASSERT_TRUE(delayMs > 0 && delayMs <= 5000);
+    TEST_ASSERT_EQUAL_UINT32(1500, (nowMs + delayMs) % 5000);
+  }
+}
+
+void test_delay_across_millis_wraparound() {
+  // Slots are on the monitor's clock modulo the interval, so the wrap shifts them once by 2^32 % 60000
+  uint32_t delayMs = pollDelayMs(3000, 60000, 0xFFFFFFFF);
+  TEST_ASSERT_TRUE(delayMs > 0 && delayMs <= 60000);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interval_follows_distance_to_threshold);
+  RUN_TEST(test_slots_spread_over_the_interval);
+  RUN_TEST(test_delay_runs_to_the_next_slot);
+  RUN_TEST(test_poll_on_its_slot_waits_a_whole_interval);
+  RUN_TEST(test_delay_across_millis_wraparound);
+  return UNITY_END();
+}
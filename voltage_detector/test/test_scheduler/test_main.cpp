@@ -0,0 +1,185 @@
+#include <unity.h>
+#include <string.h>
+#include <scheduler/scheduler.h>
+
+// The scheduler runs against a virtual clock that only moves when a test, or a task standing in for
+// slow work, moves it.
+
+static uint32_t nowUs;
+static char order[32];
+static size_t orderLength;
+static uint32_t slowTaskUs;  // How long `slowTask` takes
+
+static uint32_t virtualClock() {
+  return nowUs;
+}
+
+static void note(char name) {
+  if (orderLength < sizeof(order) - 1) {
+    order[orderLength++] = name;
+    order[orderLength] = 0;
+  }
+}
+
+static void taskA() {
+  note('a');
+}
+
+static void taskB() {
+  note('b');
+}
+
+static void taskC() {
+  note('c');
+}
+
+static void slowTask() {
+  note('s');
+  nowUs += slowTaskUs;
+}
+
+// Ticks whenever the scheduler asks to be woken, as the service task does, until `untilUs`.
+static void runUntil(Scheduler &scheduler, uint32_t untilUs) {
+  for (;;) {
+    uint32_t sleepUs = scheduler.tick();
+    if ((int32_t)(untilUs - nowUs) <= 0) {
+      return;
+    }
+    if ((int32_t)(nowUs + sleepUs - untilUs) > 0) {
+      nowUs = untilUs;
+    } else {
+      nowUs += sleepUs;
+    }
+  }
+}
+
+void setUp() {
+  nowUs = 0;
+  order[0] = 0;
+  orderLength = 0;
+  slowTaskUs = 0;
+}
+
+void tearDown() {}
+
+void test_new_tasks_run_on_the_next_tick() {
+  Scheduler scheduler(virtualClock);
+  scheduler.add("a", 100, taskA);
+  scheduler.add("b", 50, taskB);
+  TEST_ASSERT_EQUAL_UINT32(50000, scheduler.tick());
+  TEST_ASSERT_EQUAL_STRING("ab", order);
+}
+
+void test_earliest_deadline_runs_first() {
+  Scheduler scheduler(virtualClock);
+  scheduler.add("a", 300, taskA);
+  scheduler.add("b", 200, taskB);
+  scheduler.add("c", 100, taskC);
+  scheduler.tick();  // All three at 0
+  orderLength = 0;
+
+  // Woken late at 350 ms: c was due at 100, b at 200, a at 300
+  nowUs = 350000;
+  scheduler.tick();
+  TEST_ASSERT_EQUAL_STRING("cba", order);
+}
+
+void test_tick_reports_time_to_the_next_deadline() {
+  Scheduler scheduler(virtualClock);
+  scheduler.add("a", 100, taskA);
+  scheduler.add("c", 30, taskC);
+  scheduler.tick();
+  nowUs = 10000;
+  TEST_ASSERT_EQUAL_UINT32(20000, scheduler.tick());
+  nowUs = 30000;
+  TEST_ASSERT_EQUAL_UINT32(30000, scheduler.tick());  // c ran, next due at 60 ms
+  TEST_ASSERT_EQUAL_STRING("acc", order);
+}
+
+void test_late_wakeups_do_not_drift() {
+  Scheduler scheduler(virtualClock);
+  scheduler.add("a", 100, taskA);
+
+  // Woken up to 7 ms late each time; deadlines stay on the 100 ms grid, so 10 s gives 101 runs
+  uint32_t jitterUs = 0;
+  for (;;) {
+    uint32_t sleepUs = scheduler.tick();
+    if (nowUs >= 10000000) {
+      break;
+    }
+    jitterUs = (jitterUs + 3000) % 7000;
+    nowUs += sleepUs + jitterUs;
+  }
+  SchedulerReport report = scheduler.report();
+  TEST_ASSERT_EQUAL_UINT32(101, report.tasks[0].runs);
+  TEST_ASSERT_EQUAL_UINT32(0, report.tasks[0].overruns);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(7000, report.tasks[0].maxLatenessUs);
+}
+
+void test_overrun_skips_missed_runs_instead_of_bursting() {
+  Scheduler scheduler(virtualClock);
+  int slow = scheduler.add("s", 100, slowTask);
+  slowTaskUs = 250000;  // Two and a half periods
+  scheduler.tick();
+  TEST_ASSERT_EQUAL_STRING("s", order);
+
+  // Rescheduled a period after it finished rather than at the missed deadlines
+  TEST_ASSERT_EQUAL_UINT32(100000, scheduler.tick());
+  TEST_ASSERT_EQUAL_STRING("s", order);
+  SchedulerReport report = scheduler.report();
+  TEST_ASSERT_EQUAL_UINT32(1, report.tasks[slow].overruns);
+  TEST_ASSERT_EQUAL_UINT32(250000, report.tasks[slow].maxDurationUs);
+
+  // Back on time, back to a fixed rate
+  slowTaskUs = 1000;
+  nowUs = 350000;
+  TEST_ASSERT_EQUAL_UINT32(99000, scheduler.tick());
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.report().tasks[slow].overruns);
+}
+
+void test_slow_task_delays_others_by_one_run_at_most() {
+  Scheduler scheduler(virtualClock);
+  scheduler.add("s", 100, slowTask);
+  scheduler.add("a", 100, taskA);
+  slowTaskUs = 150000;
+  runUntil(scheduler, 1000000);
+  SchedulerReport report = scheduler.report();
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(report.tasks[0].runs, report.tasks[1].runs);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(150000, report.tasks[1].maxLatenessUs);
+}
+
+void test_set_period_pulls_a_faster_deadline_in() {
+  Scheduler scheduler(virtualClock);
+  int task = scheduler.add("a", 1000, taskA);
+  scheduler.tick();
+  nowUs = 100000;
+  scheduler.setPeriod(task, 200);
+  TEST_ASSERT_EQUAL_UINT32(200000, scheduler.tick());
+  nowUs = 300000;
+  scheduler.tick();
+  TEST_ASSERT_EQUAL_STRING("aa", order);
+  TEST_ASSERT_EQUAL_UINT32(200, scheduler.report().tasks[task].periodMs);
+}
+
+void test_deadlines_survive_clock_wraparound() {
+  nowUs = 0xFFFFFFFF - 150000;  // micros() wraps every 71 minutes
+  Scheduler scheduler(virtualClock);
+  scheduler.add("a", 100, taskA);
+  runUntil(scheduler, nowUs + 1000000);
+  SchedulerReport report = scheduler.report();
+  TEST_ASSERT_EQUAL_UINT32(11, report.tasks[0].runs);
+  TEST_ASSERT_EQUAL_UINT32(0, report.tasks[0].overruns);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_new_tasks_run_on_the_next_tick);
+  RUN_TEST(test_earliest_deadline_runs_first);
+  RUN_TEST(test_tick_reports_time_to_the_next_deadline);
+  RUN_TEST(test_late_wakeups_do_not_drift);
+  RUN_TEST(test_overrun_skips_missed_runs_instead_of_bursting);
+  RUN_TEST(test_slow_task_delays_others_by_one_run_at_most);
+  RUN_TEST(test_set_period_pulls_a_faster_deadline_in);
+  RUN_TEST(test_deadlines_survive_clock_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <telemetry/telemetry_state.h>
+
+// One writer and several readers hammer a Seqlock; a reader that ever sees words from two different
+// writes has caught a torn snapshot. Run under -fsanitize=thread too: pio test -e native_tsan.
+
+#define STRESS_WRITES 200000
+#define STRESS_READERS 3
+
+// Large enough to span many words, so a torn read would show.
+struct Snapshot {
+  uint32_t generation;
+  uint32_t values[30];
+  uint32_t check;  // Sum of the above
+};
+
+static Snapshot makeSnapshot(uint32_t generation) {
+  Snapshot snapshot;
+  snapshot.generation = generation;
+  snapshot.check = generation;
+  for (uint32_t i = 0; i < 30; i++) {
+    snapshot.values[i] = generation * 31 + i;
+    snapshot.check += snapshot.values[i];
+  }
+  return snapshot;
+}
+
+static bool consistent(const Snapshot &snapshot) {
+  uint32_t sum = snapshot.generation;
+  for (uint32_t i = 0; i < 30; i++) {
+    if (snapshot.values[i] != snapshot.generation * 31 + i) {
+      return false;
+    }
+    sum += snapshot.values[i];
+  }
+  return sum == snapshot.check;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_reads_before_any_write_are_zero() {
+  Seqlock<Snapshot> lock;
+  Snapshot snapshot = lock.read();
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot.generation);
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot.check);
+}
+
+void test_read_returns_the_last_write() {
+  Seqlock<Snapshot> lock;
+  for (uint32_t generation = 1; generation <= 5; generation++) {
+    lock.write(makeSnapshot(generation));
+    Snapshot snapshot = lock.read();
+    TEST_ASSERT_EQUAL_UINT32(generation, snapshot.generation);
+    TEST_ASSERT_TRUE(consistent(snapshot));
+  }
+}
+
+void test_concurrent_readers_never_see_a_torn_snapshot() {
+  Seqlock<Snapshot> lock;
+  lock.write(makeSnapshot(1));
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> torn(0);
+  std::atomic<uint32_t> backwards(0);
+  std::atomic<uint32_t> reads(0);
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < STRESS_READERS; r++) {
+    readers.emplace_back([&]() {
+      uint32_t last = 0;
+      uint32_t count = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        Snapshot snapshot = lock.read();
+        if (!consistent(snapshot)) {
+          torn.fetch_add(1);
+        }
+        if (snapshot.generation < last) {
+          backwards.fetch_add(1);  // A reader must never go back to an older snapshot
+        }
+        last = snapshot.generation;
+        count++;
+      }
+      reads.fetch_add(count);
+    });
+  }
+
+  std::thread writer([&]() {
+    for (uint32_t generation = 2; generation <= STRESS_WRITES; generation++) {
+      lock.write(makeSnapshot(generation));
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  writer.join();
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+  TEST_ASSERT_EQUAL_UINT32(0, backwards.load());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, reads.load());
+  TEST_ASSERT_EQUAL_UINT32(STRESS_WRITES, lock.read().generation);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_reads_before_any_write_are_zero);
+  RUN_TEST(test_read_returns_the_last_write);
+  RUN_TEST(test_concurrent_readers_never_see_a_torn_snapshot);
+  return UNITY_END();
+}
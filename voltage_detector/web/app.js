@@ -0,0 +1,94 @@
+(function () {
+  'use strict';
+
+  var REFRESH_MS = 5000;
+  var statusEl = document.getElementById('status');
+
+  function $(id) {
+    return document.getElementById(id);
+  }
+
+  function showStatus(text) {
+    statusEl.textContent = text;
+  }
+
+  function request(method, url, body) {
+    var options = { method: method, headers: { Accept: 'application/json' } };
+    if (body !== undefined) {
+      options.headers['Content-Type'] = 'application/json';
+      options.body = JSON.stringify(body);
+    }
+    return fetch(url, options).then(function (response) {
+      return response.json().then(function (data) {
+        if (!response.ok) {
+          throw new Error(data.error || response.status);
+        }
+        return data;
+      });
+    });
+  }
+
+  // Commands are applied asynchronously by the monitor; poll until it reports the outcome.
+  function waitForCommand(seq, label) {
+    request('GET', '/commandStatus?seq=' + seq).then(function (data) {
+      if (data.status === 'pending') {
+        setTimeout(function () { waitForCommand(seq, label); }, 250);
+      } else if (data.status === 'not_found') {
+        showStatus(label + ': device not found');
+      } else {
+        showStatus(label + ': done');
+        refresh();
+      }
+    }).catch(function (err) {
+      showStatus(label + ': ' + err.message);
+    });
+  }
+
+  function submitCommand(url, body, label) {
+    showStatus(label + '...');
+    request('POST', url, body).then(function (data) {
+      waitForCommand(data.seq, label);
+    }).catch(function (err) {
+      showStatus(label + ': ' + err.message);
+    });
+  }
+
+  function refresh() {
+    request('GET', '/getvoltage').then(function (data) {
+      ['voltage', 'percentage', 'systemType', 'setPercentageForOff'].forEach(function (key) {
+        $(key).textContent = data[key];
+      });
+    }).catch(function (err) {
+      showStatus('Monitor unreachable: ' + err.message);
+    });
+  }
+
+  $('defaultForm').addEventListener('submit', function (event) {
+    event.preventDefault();
+    submitCommand('/setdefaultoff', { percentage: Number($('defaultOff').value) }, 'Default off');
+  });
+
+  $('deviceForm').addEventListener('submit', function (event) {
+    event.preventDefault();
+    var body = {};
+    body[$('deviceId').value] = Number($('devicePercentage').value);
+    submitCommand('/setPercentageOffs', body, 'Device ' + $('deviceId').value);
+  });
+
+  $('lookupDevice').addEventListener('click', function () {
+    var id = $('deviceId').value;
+    request('GET', '/getVoltageById?deviceId=' + encodeURIComponent(id)).then(function (data) {
+      $('devicePercentage').value = data.voltage;
+      showStatus('Device ' + id + ' switches off at ' + data.voltage + '%');
+    }).catch(function (err) {
+      showStatus('Look up: ' + err.message);
+    });
+  });
+
+  $('deleteDevice').addEventListener('click', function () {
+    submitCommand('/deleteDevice', { deviceId: $('deviceId').value }, 'Delete ' + $('deviceId').value);
+  });
+
+  refresh();
+  setInterval(refresh, REFRESH_MS);
+})();